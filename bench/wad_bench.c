@@ -0,0 +1,306 @@
+/*
+** wad_bench.c
+**
+** Timed microbenchmarks of reading, counting and drawing a generated WAD
+*/
+
+#include "wad_gen.h"
+#include "wad_reader.h"
+#include "wad_dir.h"
+#include "map_drawer.h"
+#include "image_writer.h"
+#include "thing_counter.h"
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#define MAX_RUNS 64
+
+// What a benchmark works on
+typedef struct {
+    wad_handle_t*   wad;
+    const char*     wadfilename;
+    waddir_t        dir;
+    const lumpinfo_t* lumps[ML_NUMLUMPS]; // The first map's lumps
+    maparena_t      arena;
+    map_t           map;       // The first map, fully read
+    drawsettings_t  settings;
+    char            outname[256]; // Where DrawMap writes
+    thingcounts_t   counts;
+} benchctx_t;
+
+// A benchmark, doing its work iterations times
+typedef void (*benchfunc_t)( benchctx_t* ctx, uint64_t iterations );
+
+// Global configuration file, never loaded so the drawer uses its defaults
+dictionary* ini = NULL;
+
+static double minRunTime = 0.2; // Seconds each run lasts at least
+static uint32_t numRuns = 7;
+
+static double Now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int CompareDoubles( const void* a, const void* b ) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Time a benchmark. The iterations are doubled until a run takes long
+// enough, then the runs are repeated. The median and fastest runs are
+// reported along with the spread between the fastest and slowest, so a
+// noisy machine shows.
+// items is how many things one iteration handles, bytes how many bytes.
+static void RunBench( const char* name, benchfunc_t func, benchctx_t* ctx,
+                      double items, double bytes, const char* unit ) {
+    double times[MAX_RUNS];
+    double start = 0.0, elapsed = 0.0, median = 0.0;
+    uint64_t iterations = 1;
+    uint32_t r = 0;
+
+    // Warm up, and find how many iterations a run needs
+    for ( ;; ) {
+        start = Now();
+        func( ctx, iterations );
+        elapsed = Now() - start;
+        if ( elapsed >= minRunTime ) {
+            break;
+        }
+        iterations *= 2;
+    }
+    for ( r = 0; r < numRuns; ++r ) {
+        start = Now();
+        func( ctx, iterations );
+        times[r] = (Now() - start) / (double)iterations;
+    }
+    qsort( times, numRuns, sizeof(double), CompareDoubles );
+    median = times[numRuns / 2];
+
+    printf( "%-24s %10llu %14.1f %14.1f %14.0f %-10s", name,
+            (unsigned long long)iterations, median * 1e9, times[0] * 1e9,
+            items / median, unit );
+    if ( bytes > 0.0 ) {
+        printf( " %10.1f", bytes / median / 1e6 );
+    } else {
+        printf( " %10s", "-" );
+    }
+    printf( " %7.1f%%\n", (times[numRuns - 1] - times[0]) / median * 100.0 );
+}
+
+static void BenchReadHeader( benchctx_t* ctx, uint64_t iterations ) {
+    wadinfo_t info;
+    uint64_t i = 0;
+    for ( i = 0; i < iterations; ++i ) {
+        WAD_ReadHeader( ctx->wad, &info );
+    }
+}
+
+static void BenchReadDirectory( benchctx_t* ctx, uint64_t iterations ) {
+    wadfile_t wadfile;
+    uint64_t i = 0;
+    for ( i = 0; i < iterations; ++i ) {
+        wadfile.info = ctx->dir.wad.info;
+        WAD_ReadDirectory( ctx->wad, &wadfile );
+        free( wadfile.lumps );
+    }
+}
+
+static void BenchLoadDir( benchctx_t* ctx, uint64_t iterations ) {
+    waddir_t dir;
+    uint64_t i = 0;
+    for ( i = 0; i < iterations; ++i ) {
+        WAD_LoadDir( ctx->wad, ctx->wadfilename, NULL, &dir );
+        WAD_FreeDir( &dir );
+    }
+}
+
+// Each lump reader gets an arena with room for just its lump
+#define BENCH_READ_LUMP(func, lump)                                           \
+static void Bench##func( benchctx_t* ctx, uint64_t iterations ) {             \
+    map_t map;                                                                \
+    uint64_t i = 0;                                                           \
+    for ( i = 0; i < iterations; ++i ) {                                      \
+        MapArena_Reset( &ctx->arena, MapArena_Size( ctx->lumps[lump]->size ) ); \
+        WAD_##func( ctx->wad, &map, ctx->lumps[lump], &ctx->arena );          \
+    }                                                                         \
+}
+BENCH_READ_LUMP( ReadMapThings, ML_THINGS )
+BENCH_READ_LUMP( ReadMapLinedefs, ML_LINEDEFS )
+BENCH_READ_LUMP( ReadMapSidedefs, ML_SIDEDEFS )
+BENCH_READ_LUMP( ReadMapVertexes, ML_VERTEXES )
+BENCH_READ_LUMP( ReadMapSectors, ML_SECTORS )
+
+static void BenchReadMap( benchctx_t* ctx, uint64_t iterations ) {
+    map_t map;
+    uint64_t i = 0;
+    for ( i = 0; i < iterations; ++i ) {
+        WAD_ReadMap( ctx->wad, &ctx->dir.wad, &ctx->dir.maps[0],
+                     MAP_READ_THINGS | MAP_READ_LINES, &ctx->arena, &map );
+    }
+}
+
+static void BenchCountThing( benchctx_t* ctx, uint64_t iterations ) {
+    uint64_t i = 0;
+    uint32_t t = 0;
+    for ( i = 0; i < iterations; ++i ) {
+        for ( t = 0; t < ctx->map.numthings; ++t ) {
+            CountThing( &ctx->counts, ctx->map.things[t].type, ctx->map.things[t].flags );
+        }
+    }
+}
+
+static void BenchDrawMap( benchctx_t* ctx, uint64_t iterations ) {
+    uint64_t i = 0;
+    for ( i = 0; i < iterations; ++i ) {
+        DrawMap( &ctx->map, &ctx->settings, ctx->outname );
+    }
+}
+
+static void Usage( void ) {
+    fprintf( stderr,
+        "Usage: wad_bench [options]\n"
+        "  -m maps       Maps in the WAD (1)\n"
+        "  -v vertexes   Vertexes per map (4000, at most %u)\n"
+        "  -l linedefs   Linedefs per map (5000, at most %u)\n"
+        "  -s sidedefs   Sidedefs per map (8000, at most %u)\n"
+        "  -e sectors    Sectors per map (800, at most %u)\n"
+        "  -t things     Things per map (1500)\n"
+        "  -d lumps      Extra empty lumps in the directory (0)\n"
+        "  -x seed       Generator seed (1)\n"
+        "  -z size       Image size DrawMap draws (1024)\n"
+        "  -r runs       Timed runs of each benchmark (7)\n"
+        "  -T seconds    Shortest time of a run (0.2)\n"
+        "  -p            Read with pread instead of mmap\n"
+        "  -D            Skip the DrawMap benchmarks\n"
+        "  -o file       Only write the generated WAD to file\n",
+        GEN_MAX_VERTEXES, GEN_MAX_LINEDEFS, GEN_MAX_SIDEDEFS, GEN_MAX_SECTORS );
+    exit( EXIT_FAILURE );
+}
+
+int32_t main( int32_t argc, char** argv ) {
+    wadgen_t gen;
+    benchctx_t ctx;
+    char tmpdir[] = "/tmp/wad_benchXXXXXX";
+    char wadfilename[256] = "";
+    char outfile[300] = "";
+    const char* genOnly = NULL;
+    uint8_t useMmap = 1, draw = 1;
+    uint32_t size = 1024, m = 0;
+    double lumpBytes = 0.0;
+    int opt = 0;
+
+    WADGen_Defaults( &gen );
+    while ( (opt = getopt( argc, argv, "m:v:l:s:e:t:d:x:z:r:T:pDo:h" )) != -1 ) {
+        switch ( opt ) {
+        case 'm': gen.numMaps = (uint32_t)strtoul( optarg, NULL, 10 ); break;
+        case 'v': gen.numVertexes = (uint32_t)strtoul( optarg, NULL, 10 ); break;
+        case 'l': gen.numLinedefs = (uint32_t)strtoul( optarg, NULL, 10 ); break;
+        case 's': gen.numSidedefs = (uint32_t)strtoul( optarg, NULL, 10 ); break;
+        case 'e': gen.numSectors = (uint32_t)strtoul( optarg, NULL, 10 ); break;
+        case 't': gen.numThings = (uint32_t)strtoul( optarg, NULL, 10 ); break;
+        case 'd': gen.numFiller = (uint32_t)strtoul( optarg, NULL, 10 ); break;
+        case 'x': gen.seed = strtoull( optarg, NULL, 10 ); break;
+        case 'z': size = (uint32_t)strtoul( optarg, NULL, 10 ); break;
+        case 'r': numRuns = (uint32_t)strtoul( optarg, NULL, 10 ); break;
+        case 'T': minRunTime = strtod( optarg, NULL ); break;
+        case 'p': useMmap = 0; break;
+        case 'D': draw = 0; break;
+        case 'o': genOnly = optarg; break;
+        default: Usage();
+        }
+    }
+    if ( numRuns < 1 || numRuns > MAX_RUNS || gen.numMaps < 1 || size < 1 ) {
+        Usage();
+    }
+    if ( !WADGen_Clamp( &gen ) ) {
+        fprintf( stderr, "Some map sizes were over the limits and were clamped\n" );
+    }
+    if ( genOnly != NULL ) {
+        exit( WADGen_Write( &gen, genOnly ) ? EXIT_SUCCESS : EXIT_FAILURE );
+    }
+
+    // Everything is written to a scratch directory
+    if ( mkdtemp( tmpdir ) == NULL ) {
+        fprintf( stderr, "Error creating a temporary directory!\n" );
+        exit( EXIT_FAILURE );
+    }
+    snprintf( wadfilename, sizeof(wadfilename), "%s/bench.wad", tmpdir );
+    if ( !WADGen_Write( &gen, wadfilename ) ) {
+        rmdir( tmpdir );
+        exit( EXIT_FAILURE );
+    }
+
+    memset( &ctx, 0, sizeof(ctx) );
+    ctx.wadfilename = wadfilename;
+    ctx.wad = WAD_OpenFile( wadfilename, useMmap );
+    if ( ctx.wad == NULL ) {
+        remove( wadfilename );
+        rmdir( tmpdir );
+        exit( EXIT_FAILURE );
+    }
+    WAD_LoadDir( ctx.wad, wadfilename, NULL, &ctx.dir );
+    for ( m = 0; m < ML_NUMLUMPS; ++m ) {
+        uint32_t lump = ctx.dir.maps[0].lumps[m];
+        ctx.lumps[m] = (lump != LUMP_NONE) ? &ctx.dir.wad.lumps[lump] : NULL;
+    }
+    MapArena_Init( &ctx.arena );
+    LoadDrawSettings( &ctx.settings );
+    ctx.settings.maxSize = ctx.settings.sizes[0] = size;
+    ctx.settings.drawThings = 1;
+    snprintf( ctx.outname, sizeof(ctx.outname), "%s/map", tmpdir );
+    ClearThingCounts( &ctx.counts );
+
+    printf( "%u maps of %u vertexes, %u linedefs, %u sidedefs, %u sectors and %u things,"
+            " %u lumps, %s\n\n", gen.numMaps, gen.numVertexes, gen.numLinedefs,
+            gen.numSidedefs, gen.numSectors, gen.numThings, ctx.dir.wad.info.numlumps,
+            useMmap ? "mmap" : "pread" );
+    printf( "%-24s %10s %14s %14s %14s %-10s %10s %8s\n", "benchmark", "iterations",
+            "ns/op", "best ns/op", "rate", "", "MB/s", "spread" );
+
+    RunBench( "WAD_ReadHeader", BenchReadHeader, &ctx, 1, sizeof(wadinfo_t), "headers/s" );
+    RunBench( "WAD_ReadDirectory", BenchReadDirectory, &ctx, ctx.dir.wad.info.numlumps,
+              (double)ctx.dir.wad.info.numlumps * sizeof(lumpinfo_t), "lumps/s" );
+    RunBench( "WAD_LoadDir", BenchLoadDir, &ctx, ctx.dir.wad.info.numlumps,
+              (double)ctx.dir.wad.info.numlumps * sizeof(lumpinfo_t), "lumps/s" );
+    RunBench( "WAD_ReadMapThings", BenchReadMapThings, &ctx, gen.numThings,
+              ctx.lumps[ML_THINGS]->size, "things/s" );
+    RunBench( "WAD_ReadMapLinedefs", BenchReadMapLinedefs, &ctx, gen.numLinedefs,
+              ctx.lumps[ML_LINEDEFS]->size, "lines/s" );
+    RunBench( "WAD_ReadMapSidedefs", BenchReadMapSidedefs, &ctx, gen.numSidedefs,
+              ctx.lumps[ML_SIDEDEFS]->size, "sides/s" );
+    RunBench( "WAD_ReadMapVertexes", BenchReadMapVertexes, &ctx, gen.numVertexes,
+              ctx.lumps[ML_VERTEXES]->size, "verts/s" );
+    RunBench( "WAD_ReadMapSectors", BenchReadMapSectors, &ctx, gen.numSectors,
+              ctx.lumps[ML_SECTORS]->size, "sectors/s" );
+    for ( m = 0; m < ML_NUMLUMPS; ++m ) {
+        lumpBytes += (ctx.lumps[m] != NULL) ? ctx.lumps[m]->size : 0;
+    }
+    RunBench( "WAD_ReadMap", BenchReadMap, &ctx, 1, lumpBytes, "maps/s" );
+
+    // The rest work on the map once it's read
+    WAD_ReadMap( ctx.wad, &ctx.dir.wad, &ctx.dir.maps[0],
+                 MAP_READ_THINGS | MAP_READ_LINES, &ctx.arena, &ctx.map );
+    RunBench( "CountThing", BenchCountThing, &ctx, gen.numThings, 0, "things/s" );
+    if ( draw ) {
+        ctx.settings.renderer = RENDERER_CAIRO;
+        RunBench( "DrawMap (cairo)", BenchDrawMap, &ctx, gen.numLinedefs, 0, "lines/s" );
+        ctx.settings.renderer = RENDERER_NATIVE;
+        RunBench( "DrawMap (native)", BenchDrawMap, &ctx, gen.numLinedefs, 0, "lines/s" );
+    }
+
+    // Cleanup
+    MapArena_Free( &ctx.arena );
+    WAD_FreeDir( &ctx.dir );
+    WAD_CloseFile( ctx.wad );
+    remove( wadfilename );
+    snprintf( outfile, sizeof(outfile), "%s.svg", ctx.outname );
+    remove( outfile );
+    snprintf( outfile, sizeof(outfile), "%s.%s", ctx.outname,
+              IMG_Extension( (imageformat_t)ctx.settings.imageFormat ) );
+    remove( outfile );
+    rmdir( tmpdir );
+    exit( EXIT_SUCCESS );
+}
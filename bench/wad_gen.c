@@ -0,0 +1,250 @@
+/*
+** wad_gen.c
+**
+** Deterministic synthetic WADs for benchmarking
+*/
+
+#include "wad_gen.h"
+#include "buf_writer.h"
+
+// Lumps of each generated map, after its marker
+enum {
+    GL_THINGS, GL_LINEDEFS, GL_SIDEDEFS, GL_VERTEXES, GL_SEGS, GL_SSECTORS,
+    GL_NODES, GL_SECTORS, GL_REJECT, GL_BLOCKMAP, GL_NUMLUMPS
+};
+static const char* const genLumpNames[GL_NUMLUMPS] = {
+    "THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS", "SSECTORS",
+    "NODES", "SECTORS", "REJECT", "BLOCKMAP"
+};
+
+// Thing types placed, a mix of counted, marked and ignored ones
+static const int16_t genThingTypes[] = {
+    3001, 3004, 9, 3002, 3005, 3003, 2001, 2002, 2048, 2049, 2011, 2012,
+    2014, 2015, 2018, 5, 6, 13, 48, 2028, 35, 10
+};
+
+// Specials given to some lines, doors, keyed doors, triggers and effects
+static const int16_t genSpecials[] = {1, 26, 27, 28, 31, 97, 36, 48, 62, 88};
+
+#define PLAYPAL_SIZE 768
+
+// xorshift64*, small and the same everywhere
+static uint32_t Rand( uint64_t* state ) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (uint32_t)((*state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+// Random number from 0 to n - 1
+#define RAND_BELOW(state, n) ((uint32_t)(((uint64_t)Rand( state ) * (n)) >> 32))
+
+// Values are written byte by byte so the WAD is little-endian anywhere
+static void Put16( bufwriter_t* bw, int32_t value ) {
+    char b[2] = {(char)(value & 0xFF), (char)((value >> 8) & 0xFF)};
+    BW_Write( bw, b, 2 );
+}
+
+static void Put32( bufwriter_t* bw, uint32_t value ) {
+    Put16( bw, (int32_t)(value & 0xFFFF) );
+    Put16( bw, (int32_t)(value >> 16) );
+}
+
+// Write a name padded with NULs to 8 characters
+static void PutName( bufwriter_t* bw, const char* name ) {
+    char padded[8] = {0};
+    size_t len = strlen( name );
+    memcpy( padded, name, (len < 8) ? len : 8 );
+    BW_Write( bw, padded, 8 );
+}
+
+void WADGen_Defaults( wadgen_t* gen ) {
+    gen->numMaps = 1;
+    gen->numVertexes = 4000;
+    gen->numLinedefs = 5000;
+    gen->numSidedefs = 8000;
+    gen->numSectors = 800;
+    gen->numThings = 1500;
+    gen->numFiller = 0;
+    gen->seed = 1;
+}
+
+// Clamp one size, clearing ok if it had to be
+static uint32_t ClampSize( uint32_t value, uint32_t max, uint8_t* ok ) {
+    if ( value > max ) {
+        *ok = 0;
+        return max;
+    }
+    return value;
+}
+
+uint8_t WADGen_Clamp( wadgen_t* gen ) {
+    uint8_t ok = 1;
+
+    gen->numVertexes = ClampSize( gen->numVertexes, GEN_MAX_VERTEXES, &ok );
+    gen->numLinedefs = ClampSize( gen->numLinedefs, GEN_MAX_LINEDEFS, &ok );
+    gen->numSidedefs = ClampSize( gen->numSidedefs, GEN_MAX_SIDEDEFS, &ok );
+    gen->numSectors = ClampSize( gen->numSectors, GEN_MAX_SECTORS, &ok );
+    gen->numThings = ClampSize( gen->numThings, GEN_MAX_THINGS, &ok );
+    // Lines need somewhere to start and end, and sides a sector to face
+    if ( gen->numVertexes < 2 ) {
+        gen->numVertexes = 2;
+    }
+    if ( gen->numSectors < 1 ) {
+        gen->numSectors = 1;
+    }
+    return ok;
+}
+
+// Size in bytes of each lump of a map
+static void GetLumpSizes( const wadgen_t* gen, uint32_t sizes[GL_NUMLUMPS] ) {
+    memset( sizes, 0, sizeof(uint32_t) * GL_NUMLUMPS );
+    sizes[GL_THINGS] = gen->numThings * sizeof(thing_t);
+    sizes[GL_LINEDEFS] = gen->numLinedefs * sizeof(linedef_t);
+    sizes[GL_SIDEDEFS] = gen->numSidedefs * sizeof(sidedef_t);
+    sizes[GL_VERTEXES] = gen->numVertexes * sizeof(vertex_t);
+    sizes[GL_SECTORS] = gen->numSectors * sizeof(sector_t);
+}
+
+// Write one map's lumps. The vertexes are a jittered square grid filling
+// most of the coordinate range, and each line joins a vertex to one of
+// its grid neighbours.
+static void WriteMap( bufwriter_t* bw, const wadgen_t* gen, uint64_t* rng ) {
+    uint32_t grid = 1, spacing = 0, i = 0;
+
+    while ( grid * grid < gen->numVertexes ) {
+        ++grid;
+    }
+    spacing = 60000 / grid;
+
+    for ( i = 0; i < gen->numThings; ++i ) {
+        // Player 1 start first, the rest on random skills, some multiplayer
+        int16_t type = (i == 0) ? 1 : genThingTypes[RAND_BELOW( rng,
+                                   sizeof(genThingTypes) / sizeof(genThingTypes[0]) )];
+        Put16( bw, (int32_t)RAND_BELOW( rng, grid * spacing ) - 30000 );
+        Put16( bw, (int32_t)RAND_BELOW( rng, grid * spacing ) - 30000 );
+        Put16( bw, (int32_t)RAND_BELOW( rng, 8 ) * 45 );
+        Put16( bw, type );
+        Put16( bw, (i == 0) ? TFLAG_SK_ALL : (int32_t)(RAND_BELOW( rng, 7 ) + 1) |
+               ((RAND_BELOW( rng, 8 ) == 0) ? TFLAG_MULT : 0) );
+    }
+
+    for ( i = 0; i < gen->numLinedefs; ++i ) {
+        uint32_t v1 = RAND_BELOW( rng, gen->numVertexes ), v2 = 0;
+        uint32_t col = v1 % grid;
+        // Right or down, or left or up at the edges
+        if ( (RAND_BELOW( rng, 2 ) || v1 + grid >= gen->numVertexes) &&
+             col + 1 < grid && v1 + 1 < gen->numVertexes ) {
+            v2 = v1 + 1;
+        } else if ( v1 + grid < gen->numVertexes ) {
+            v2 = v1 + grid;
+        } else {
+            v2 = (col > 0) ? v1 - 1 : v1 - grid;
+        }
+        Put16( bw, (int32_t)v1 );
+        Put16( bw, (int32_t)v2 );
+        Put16( bw, (int32_t)RAND_BELOW( rng, 64 ) );
+        Put16( bw, (RAND_BELOW( rng, 16 ) == 0) ? genSpecials[RAND_BELOW( rng,
+                   sizeof(genSpecials) / sizeof(genSpecials[0]) )] : 0 );
+        Put16( bw, 0 );
+        // Every line has a front side if there are any, half have a back
+        Put16( bw, gen->numSidedefs ? (int32_t)RAND_BELOW( rng, gen->numSidedefs ) : -1 );
+        Put16( bw, (gen->numSidedefs && RAND_BELOW( rng, 2 )) ?
+                   (int32_t)RAND_BELOW( rng, gen->numSidedefs ) : -1 );
+    }
+
+    for ( i = 0; i < gen->numSidedefs; ++i ) {
+        Put16( bw, (int32_t)RAND_BELOW( rng, 64 ) );
+        Put16( bw, 0 );
+        PutName( bw, "-" );
+        PutName( bw, "-" );
+        PutName( bw, "STARTAN3" );
+        Put16( bw, (int32_t)RAND_BELOW( rng, gen->numSectors ) );
+    }
+
+    for ( i = 0; i < gen->numVertexes; ++i ) {
+        Put16( bw, (int32_t)((i % grid) * spacing + RAND_BELOW( rng, spacing / 2 + 1 )) - 30000 );
+        Put16( bw, (int32_t)((i / grid) * spacing + RAND_BELOW( rng, spacing / 2 + 1 )) - 30000 );
+    }
+
+    for ( i = 0; i < gen->numSectors; ++i ) {
+        // A few floor and ceiling heights so lines get every style
+        int32_t floor = (int32_t)RAND_BELOW( rng, 4 ) * 16;
+        Put16( bw, floor );
+        Put16( bw, floor + 128 + (int32_t)RAND_BELOW( rng, 2 ) * 8 );
+        PutName( bw, "FLOOR4_8" );
+        PutName( bw, "CEIL3_5" );
+        Put16( bw, 160 );
+        Put16( bw, 0 );
+        Put16( bw, 0 );
+    }
+}
+
+/*
+** Write a PWAD with a palette and the maps, followed by the filler lumps
+*/
+uint8_t WADGen_Write( const wadgen_t* gen, const char* filename ) {
+    uint32_t sizes[GL_NUMLUMPS];
+    uint64_t mapSize = 0, dirOfs = 0, rng = gen->seed * 0x9E3779B97F4A7C15ULL + 1;
+    uint64_t numlumps = 1 + (uint64_t)gen->numMaps * (GL_NUMLUMPS + 1) + gen->numFiller;
+    uint32_t filepos = 0, m = 0, l = 0;
+    char name[16] = "";
+    bufwriter_t* bw = NULL;
+
+    GetLumpSizes( gen, sizes );
+    for ( l = 0; l < GL_NUMLUMPS; ++l ) {
+        mapSize += sizes[l];
+    }
+    dirOfs = sizeof(wadinfo_t) + PLAYPAL_SIZE + mapSize * gen->numMaps;
+    if ( dirOfs > UINT32_MAX || numlumps > UINT32_MAX ) {
+        fprintf( stderr, "Error! Generated WAD would be too big!\n" );
+        return 0;
+    }
+    bw = BW_Open( filename );
+    if ( bw == NULL ) {
+        fprintf( stderr, "Error opening %s for writing!\n", filename );
+        return 0;
+    }
+
+    // Header, then all the lump data in directory order
+    BW_Write( bw, "PWAD", 4 );
+    Put32( bw, (uint32_t)numlumps );
+    Put32( bw, (uint32_t)dirOfs );
+    // A palette of grays
+    for ( l = 0; l < PLAYPAL_SIZE; ++l ) {
+        BW_PutChar( bw, (char)(l / 3) );
+    }
+    for ( m = 0; m < gen->numMaps; ++m ) {
+        WriteMap( bw, gen, &rng );
+    }
+
+    // The directory
+    filepos = sizeof(wadinfo_t);
+    Put32( bw, filepos );
+    Put32( bw, PLAYPAL_SIZE );
+    PutName( bw, "PLAYPAL" );
+    filepos += PLAYPAL_SIZE;
+    for ( m = 0; m < gen->numMaps; ++m ) {
+        snprintf( name, sizeof(name), "MAP%02u", m + 1 );
+        Put32( bw, filepos );
+        Put32( bw, 0 );
+        PutName( bw, name );
+        for ( l = 0; l < GL_NUMLUMPS; ++l ) {
+            Put32( bw, filepos );
+            Put32( bw, sizes[l] );
+            PutName( bw, genLumpNames[l] );
+            filepos += sizes[l];
+        }
+    }
+    for ( l = 0; l < gen->numFiller; ++l ) {
+        snprintf( name, sizeof(name), "F%07u", l % 10000000 );
+        Put32( bw, (uint32_t)dirOfs );
+        Put32( bw, 0 );
+        PutName( bw, name );
+    }
+    if ( !BW_Close( bw ) ) {
+        fprintf( stderr, "Error writing %s!\n", filename );
+        return 0;
+    }
+    return 1;
+}
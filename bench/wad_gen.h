@@ -0,0 +1,50 @@
+/*
+** wad_gen.h
+**
+** Deterministic synthetic WADs for benchmarking
+*/
+
+#ifndef __WAD_GEN_H
+#define __WAD_GEN_H
+
+#include "shared.h"
+
+// Most of each kind of map entry a generated map can have. Boom's limits
+// for everything indexed by 16 bits, except sidedefs which the reader
+// numbers with the vanilla signed sidenum.
+#define GEN_MAX_VERTEXES 65535
+#define GEN_MAX_LINEDEFS 65535
+#define GEN_MAX_SIDEDEFS 32767
+#define GEN_MAX_SECTORS  65535
+#define GEN_MAX_THINGS   100000000 // Only limited by the lump size
+
+// What to generate
+typedef struct {
+    uint32_t numMaps;     // Maps, named MAP01, MAP02, ...
+    uint32_t numVertexes; // Per map
+    uint32_t numLinedefs;
+    uint32_t numSidedefs;
+    uint32_t numSectors;
+    uint32_t numThings;
+    uint32_t numFiller;   // Empty lumps after the maps to grow the directory
+    uint64_t seed;        // The same seed always gives the same WAD
+} wadgen_t;
+
+/*
+** Fill in the default sizes, a map about as big as a large vanilla one
+*/
+void WADGen_Defaults( wadgen_t* gen );
+
+/*
+** Clamp the sizes to the GEN_MAX_* limits. Returns 0 if anything had to be
+** clamped.
+*/
+uint8_t WADGen_Clamp( wadgen_t* gen );
+
+/*
+** Write a PWAD with a palette and the maps, followed by the filler lumps.
+** Returns 0 if the file couldn't be written.
+*/
+uint8_t WADGen_Write( const wadgen_t* gen, const char* filename );
+
+#endif
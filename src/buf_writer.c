@@ -0,0 +1,176 @@
+/*
+** buf_writer.c
+**
+** Buffered text output with fast hand-written number formatting
+*/
+
+#include "buf_writer.h"
+#include "phase_stats.h"
+#include <math.h>
+
+/*
+** Open a file for writing
+*/
+bufwriter_t* BW_Open( const char* filename ) {
+    FILE* f = fopen( filename, "wb" );
+    outsink_t sink;
+    bufwriter_t* bw = NULL;
+
+    if ( f == NULL ) {
+        return NULL;
+    }
+    sink = Sink_File( f );
+    bw = BW_OpenSink( &sink );
+    if ( bw == NULL ) {
+        fclose( f );
+        return NULL;
+    }
+    bw->f = f;
+    return bw;
+}
+
+/*
+** Start writing to a sink
+*/
+bufwriter_t* BW_OpenSink( const outsink_t* sink ) {
+    bufwriter_t* bw = (bufwriter_t*)malloc( sizeof(bufwriter_t) );
+
+    if ( bw == NULL ) {
+        return NULL;
+    }
+    Stats_AddAlloc();
+    bw->sink = *sink;
+    bw->f = NULL;
+    bw->used = 0;
+    bw->failed = 0;
+    return bw;
+}
+
+static void Flush( bufwriter_t* bw ) {
+    if ( bw->used > 0 && !bw->sink.write( bw->sink.ctx, bw->buf, bw->used ) ) {
+        bw->failed = 1;
+    }
+    bw->used = 0;
+}
+
+/*
+** Flush and close the file and free the writer
+*/
+uint8_t BW_Close( bufwriter_t* bw ) {
+    uint8_t ok = 0;
+
+    Flush( bw );
+    if ( bw->f != NULL && fclose( bw->f ) != 0 ) {
+        bw->failed = 1;
+    }
+    ok = !bw->failed;
+    free( bw );
+    return ok;
+}
+
+/*
+** Write len bytes
+*/
+void BW_Write( bufwriter_t* bw, const char* data, size_t len ) {
+    if ( bw->used + len > BUFWRITER_SIZE ) {
+        Flush( bw );
+        // Too big to be worth buffering
+        if ( len > BUFWRITER_SIZE ) {
+            if ( !bw->sink.write( bw->sink.ctx, data, len ) ) {
+                bw->failed = 1;
+            }
+            return;
+        }
+    }
+    memcpy( bw->buf + bw->used, data, len );
+    bw->used += len;
+}
+
+/*
+** Write a NUL terminated string
+*/
+void BW_PutStr( bufwriter_t* bw, const char* str ) {
+    BW_Write( bw, str, strlen( str ) );
+}
+
+/*
+** Write a single character
+*/
+void BW_PutChar( bufwriter_t* bw, char c ) {
+    if ( bw->used == BUFWRITER_SIZE ) {
+        Flush( bw );
+    }
+    bw->buf[bw->used++] = c;
+}
+
+/*
+** Write an integer in decimal
+*/
+void BW_PutInt( bufwriter_t* bw, int64_t value ) {
+    char digits[24];
+    uint32_t n = sizeof(digits);
+    // Work with the magnitude as unsigned so INT64_MIN is fine too
+    uint64_t mag = (value < 0) ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+
+    do {
+        digits[--n] = (char)('0' + mag % 10);
+        mag /= 10;
+    } while ( mag > 0 );
+    if ( value < 0 ) {
+        digits[--n] = '-';
+    }
+    BW_Write( bw, digits + n, sizeof(digits) - n );
+}
+
+/*
+** Write a number rounded to a number of decimal places
+*/
+void BW_PutFixed( bufwriter_t* bw, double value, uint8_t decimals ) {
+    static const int64_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    int64_t scaled = 0, whole = 0, frac = 0, power = 0;
+
+    if ( decimals > 6 ) {
+        decimals = 6;
+    }
+    power = powers[decimals];
+    scaled = (int64_t)llround( value * (double)power );
+    if ( scaled < 0 ) {
+        BW_PutChar( bw, '-' );
+        scaled = -scaled;
+    }
+    whole = scaled / power;
+    frac = scaled % power;
+    BW_PutInt( bw, whole );
+    if ( frac != 0 ) {
+        char digits[8];
+        uint32_t n = decimals, d = 0;
+        // Leave off the trailing zeros
+        while ( frac % 10 == 0 ) {
+            frac /= 10;
+            --n;
+        }
+        digits[0] = '.';
+        for ( d = n; d > 0; --d ) {
+            digits[d] = (char)('0' + frac % 10);
+            frac /= 10;
+        }
+        BW_Write( bw, digits, 1 + n );
+    }
+}
+
+/*
+** Write a color as #rrggbb
+*/
+void BW_PutColor( bufwriter_t* bw, color_t color ) {
+    static const char hex[] = "0123456789abcdef";
+    char out[7];
+
+    out[0] = '#';
+    out[1] = hex[color.r >> 4];
+    out[2] = hex[color.r & 15];
+    out[3] = hex[color.g >> 4];
+    out[4] = hex[color.g & 15];
+    out[5] = hex[color.b >> 4];
+    out[6] = hex[color.b & 15];
+    BW_Write( bw, out, sizeof(out) );
+}
@@ -0,0 +1,70 @@
+/*
+** buf_writer.h
+**
+** Buffered text output with fast hand-written number formatting
+*/
+
+#ifndef __BUF_WRITER_H
+#define __BUF_WRITER_H
+
+#include "shared.h"
+#include "out_sink.h"
+
+#define BUFWRITER_SIZE 65536
+
+typedef struct {
+    outsink_t sink;
+    FILE*     f;      // File opened by BW_Open, NULL when writing to a sink
+    size_t    used;
+    uint8_t   failed; // Set once anything couldn't be written
+    char      buf[BUFWRITER_SIZE];
+} bufwriter_t;
+
+/*
+** Open a file for writing. Returns NULL on failure.
+*/
+bufwriter_t* BW_Open( const char* filename );
+
+/*
+** Start writing to a sink. Returns NULL on failure.
+*/
+bufwriter_t* BW_OpenSink( const outsink_t* sink );
+
+/*
+** Flush and close the file and free the writer. A sink is flushed but
+** left to the caller. Returns 0 if anything failed to be written.
+*/
+uint8_t BW_Close( bufwriter_t* bw );
+
+/*
+** Write len bytes
+*/
+void BW_Write( bufwriter_t* bw, const char* data, size_t len );
+
+/*
+** Write a NUL terminated string
+*/
+void BW_PutStr( bufwriter_t* bw, const char* str );
+
+/*
+** Write a single character
+*/
+void BW_PutChar( bufwriter_t* bw, char c );
+
+/*
+** Write an integer in decimal
+*/
+void BW_PutInt( bufwriter_t* bw, int64_t value );
+
+/*
+** Write a number rounded to a number of decimal places, leaving off
+** trailing zeros
+*/
+void BW_PutFixed( bufwriter_t* bw, double value, uint8_t decimals );
+
+/*
+** Write a color as #rrggbb
+*/
+void BW_PutColor( bufwriter_t* bw, color_t color );
+
+#endif
@@ -0,0 +1,106 @@
+/*
+** display_list.c
+**
+** A map reduced to what gets drawn, built once and drawn any number of
+** times at any size
+*/
+
+#include "display_list.h"
+#include "map_drawer.h"
+#include "phase_stats.h"
+#include "trace.h"
+
+// Allocate part of a display list, always at least one item
+static void* DLAlloc( size_t size, uint32_t count ) {
+    void* p = malloc( size * (count + 1) );
+    if ( p == NULL ) {
+        fprintf( stderr, "Error allocating display list!\n" );
+        exit( EXIT_FAILURE );
+    }
+    Stats_AddAlloc();
+    return p;
+}
+
+/*
+** Sort a display list's lines by style
+*/
+void DL_SortByStyle( displaylist_t* dl ) {
+    uint32_t starts[LS_NUMSTYLES + 1] = {0};
+    uint32_t i = 0, s = 0;
+
+    for ( i = 0; i < dl->numlines; ++i ) {
+        ++starts[dl->lines[i].style + 1];
+    }
+    for ( s = 1; s <= LS_NUMSTYLES; ++s ) {
+        starts[s] += starts[s - 1];
+    }
+    memcpy( dl->styleStarts, starts, sizeof(starts) );
+    free( dl->byStyle );
+    dl->byStyle = (uint32_t*)DLAlloc( sizeof(uint32_t), dl->numlines );
+    for ( i = 0; i < dl->numlines; ++i ) {
+        dl->byStyle[starts[dl->lines[i].style]++] = i;
+    }
+}
+
+/*
+** Build the display list for a map
+*/
+void DL_Build( displaylist_t* dl, const map_t* map, uint8_t withThings ) {
+    tracespan_t span;
+    uint32_t i = 0;
+
+    memset( dl, 0, sizeof(displaylist_t) );
+    memcpy( dl->name, map->name, sizeof(dl->name) );
+    dl->width = map->width;
+    dl->height = map->height;
+    dl->centerv = map->centerv;
+    dl->numverts = map->numvertexes;
+    dl->verts = (vertex_t*)DLAlloc( sizeof(vertex_t), map->numvertexes );
+    if ( map->numvertexes > 0 ) {
+        memcpy( dl->verts, map->vertexes, sizeof(vertex_t) * map->numvertexes );
+    }
+
+    // Classify every line once
+    Trace_Begin( &span, "DL_Build linedefs" );
+    dl->lines = (dlline_t*)DLAlloc( sizeof(dlline_t), map->numlinedefs );
+    for ( i = 0; i < map->numlinedefs; ++i ) {
+        const linedef_t* linedef = &map->linedefs[i];
+        dlline_t* line = &dl->lines[dl->numlines];
+        // Skip lines with broken vertex numbers
+        if ( linedef->v1 >= map->numvertexes || linedef->v2 >= map->numvertexes ) {
+            continue;
+        }
+        line->v1 = linedef->v1;
+        line->v2 = linedef->v2;
+        line->style = (uint8_t)GetLineStyle( map, linedef );
+        ++dl->numlines;
+    }
+    DL_SortByStyle( dl );
+    Trace_End( &span );
+
+    // Things that get a marker
+    Trace_Begin( &span, "DL_Build things" );
+    dl->markers = (dlmarker_t*)DLAlloc( sizeof(dlmarker_t), withThings ? map->numthings : 0 );
+    for ( i = 0; withThings && i < map->numthings; ++i ) {
+        dlmarker_t* marker = &dl->markers[dl->nummarkers];
+        double radius = 0.0;
+        if ( GetThingMarker( map->things[i].type, &marker->color, &radius ) ) {
+            marker->x = map->things[i].x;
+            marker->y = map->things[i].y;
+            marker->radius = (uint16_t)radius;
+            ++dl->nummarkers;
+        }
+    }
+    Trace_End( &span );
+}
+
+/*
+** Free a display list
+*/
+void DL_Free( displaylist_t* dl ) {
+    free( dl->verts );
+    free( dl->lines );
+    free( dl->byStyle );
+    free( dl->markers );
+    memset( dl, 0, sizeof(displaylist_t) );
+}
@@ -0,0 +1,76 @@
+/*
+** display_list.h
+**
+** A map reduced to what gets drawn, built once and drawn any number of
+** times at any size
+*/
+
+#ifndef __DISPLAY_LIST_H
+#define __DISPLAY_LIST_H
+
+#include "shared.h"
+
+// How a line is drawn. Lines are drawn in this order when batched by style
+// so the more important ones end up on top.
+typedef enum {
+    LS_WALL,       // One sided wall
+    LS_SAMEHEIGHT, // Between sectors with the same heights
+    LS_CEILDIFF,   // Between sectors with different ceiling heights
+    LS_FLOORDIFF,  // Between sectors with different floor heights
+    LS_TRIGGER,    // Has a special
+    LS_BLUEKEY,    // Blue locked door
+    LS_REDKEY,     // Red locked door
+    LS_YELLOWKEY,  // Yellow locked door
+    LS_NUMSTYLES
+} linestyle_t;
+
+// A line to draw between two of the display list's vertexes
+typedef struct {
+    uint32_t v1, v2;
+    uint8_t  style; // A linestyle_t
+} dlline_t;
+
+// A filled square marking a thing
+typedef struct {
+    int16_t  x, y;   // Center in map units
+    uint16_t radius; // Half the width in map units
+    color_t  color;
+} dlmarker_t;
+
+// Everything drawn for a map, all in map units
+typedef struct {
+    char        name[8];
+    uint32_t    width, height; // Map size
+    vertex_t    centerv;       // Center point of the map
+    uint32_t    numverts;
+    vertex_t*   verts;
+    // Lines in linedef order, lines with broken vertex numbers are left out
+    uint32_t    numlines;
+    dlline_t*   lines;
+    // Line numbers sorted by style, keeping their order within each style.
+    // Style s is byStyle[styleStarts[s]] to byStyle[styleStarts[s + 1] - 1].
+    uint32_t*   byStyle;
+    uint32_t    styleStarts[LS_NUMSTYLES + 1];
+    uint32_t    nummarkers;
+    dlmarker_t* markers;
+} displaylist_t;
+
+/*
+** Build the display list for a map. Lines are classified once here. Thing
+** markers are only added if withThings is set. The display list doesn't
+** point into the map, so the map can be freed afterwards.
+*/
+void DL_Build( displaylist_t* dl, const map_t* map, uint8_t withThings );
+
+/*
+** Sort a display list's lines by style into byStyle and styleStarts. Only
+** needed after changing the lines of a display list.
+*/
+void DL_SortByStyle( displaylist_t* dl );
+
+/*
+** Free a display list
+*/
+void DL_Free( displaylist_t* dl );
+
+#endif
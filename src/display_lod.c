@@ -0,0 +1,305 @@
+/*
+** display_lod.c
+**
+** Simplifies a display list for drawing at a small scale
+*/
+
+#include "display_lod.h"
+#include "phase_stats.h"
+
+// Longest run of lines merged into one, this keeps the straightness check
+// cheap on long curves
+#define MAX_RUN 64
+
+// A line while simplifying
+typedef struct {
+    uint32_t v1, v2;
+    uint32_t first; // Line number in the original display list
+    uint8_t  style;
+} lodline_t;
+
+// A merged line and where it goes in the drawing order
+typedef struct {
+    dlline_t line;
+    uint32_t first;
+} lodout_t;
+
+static void* LODAlloc( size_t size, uint32_t count ) {
+    void* p = calloc( count + 1, size );
+    if ( p == NULL ) {
+        fprintf( stderr, "Error allocating display list!\n" );
+        exit( EXIT_FAILURE );
+    }
+    Stats_AddAlloc();
+    return p;
+}
+
+static uint64_t HashKey( uint64_t key ) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// Merge vertexes sharing a cell of a grid. rep gets the vertex each one is
+// merged into, which is the first in its cell.
+static void ClusterVerts( const displaylist_t* dl, double cellSize, uint32_t* rep ) {
+    uint32_t numSlots = 16, mask = 0, v = 0;
+    uint64_t* keys = NULL;
+    uint32_t* verts = NULL;
+
+    while ( numSlots < dl->numverts * 2 ) {
+        numSlots <<= 1;
+    }
+    mask = numSlots - 1;
+    keys = (uint64_t*)LODAlloc( sizeof(uint64_t), numSlots );
+    verts = (uint32_t*)LODAlloc( sizeof(uint32_t), numSlots );
+    for ( v = 0; v < numSlots; ++v ) {
+        verts[v] = 0xFFFFFFFF;
+    }
+    for ( v = 0; v < dl->numverts; ++v ) {
+        int64_t cx = (int64_t)((dl->verts[v].x + 32768.0) / cellSize);
+        int64_t cy = (int64_t)((dl->verts[v].y + 32768.0) / cellSize);
+        uint64_t key = ((uint64_t)cx << 32) | (uint64_t)cy;
+        uint32_t slot = (uint32_t)HashKey( key ) & mask;
+        while ( verts[slot] != 0xFFFFFFFF && keys[slot] != key ) {
+            slot = (slot + 1) & mask;
+        }
+        if ( verts[slot] == 0xFFFFFFFF ) {
+            keys[slot] = key;
+            verts[slot] = v;
+        }
+        rep[v] = verts[slot];
+    }
+    free( keys );
+    free( verts );
+}
+
+// Drop lines drawn twice. Returns the number of lines left.
+static uint32_t DropLines( lodline_t* lines, uint32_t numLines ) {
+    uint32_t numSlots = 16, mask = 0, i = 0, count = 0;
+    uint64_t* keys = NULL;
+    uint32_t* index = NULL; // Where each key's line went, plus one
+
+    while ( numSlots < numLines * 2 ) {
+        numSlots <<= 1;
+    }
+    mask = numSlots - 1;
+    keys = (uint64_t*)LODAlloc( sizeof(uint64_t), numSlots );
+    index = (uint32_t*)LODAlloc( sizeof(uint32_t), numSlots );
+    for ( i = 0; i < numLines; ++i ) {
+        lodline_t* line = &lines[i];
+        uint32_t a = (line->v1 < line->v2) ? line->v1 : line->v2;
+        uint32_t b = (line->v1 < line->v2) ? line->v2 : line->v1;
+        uint64_t key = ((uint64_t)a << 32) | b;
+        uint32_t slot = (uint32_t)HashKey( key ) & mask;
+        while ( index[slot] != 0 && keys[slot] != key ) {
+            slot = (slot + 1) & mask;
+        }
+        // Two lines between the same vertexes only need one drawn. The one
+        // drawn last would have ended up on top, so it takes the earlier
+        // one's place, keeping its own style and place in the draw order.
+        if ( index[slot] != 0 ) {
+            lines[index[slot] - 1] = *line;
+            continue;
+        }
+        keys[slot] = key;
+        lines[count++] = *line;
+        index[slot] = count;
+    }
+    free( keys );
+    free( index );
+    return count;
+}
+
+// Check the vertexes between s and e are all within tolerance of the line
+// from s to e and in order along it
+static uint8_t IsStraight( const vertex_t* verts, uint32_t s, uint32_t e,
+                           const uint32_t* between, uint32_t numBetween,
+                           double tolerance ) {
+    double dx = verts[e].x - verts[s].x, dy = verts[e].y - verts[s].y;
+    double len2 = dx * dx + dy * dy, last = 0.0;
+    uint32_t i = 0;
+
+    if ( len2 == 0.0 ) {
+        return 0;
+    }
+    for ( i = 0; i < numBetween; ++i ) {
+        double px = verts[between[i]].x - verts[s].x, py = verts[between[i]].y - verts[s].y;
+        double along = (px * dx + py * dy) / len2;
+        double cross = px * dy - py * dx;
+        if ( along <= last || along >= 1.0 || cross * cross > tolerance * tolerance * len2 ) {
+            return 0;
+        }
+        last = along;
+    }
+    return 1;
+}
+
+static int CompareOut( const void* a, const void* b ) {
+    uint32_t fa = ((const lodout_t*)a)->first, fb = ((const lodout_t*)b)->first;
+    return (fa > fb) - (fa < fb);
+}
+
+/*
+** Make a simplified copy of a display list
+*/
+uint32_t DL_Simplify( displaylist_t* out, const displaylist_t* dl, double scale ) {
+    double tolerance = LOD_TOLERANCE / scale; // In map units
+    uint32_t* rep = (uint32_t*)LODAlloc( sizeof(uint32_t), dl->numverts );
+    lodline_t* lines = (lodline_t*)LODAlloc( sizeof(lodline_t), dl->numlines );
+    uint32_t* degree = (uint32_t*)LODAlloc( sizeof(uint32_t), dl->numverts );
+    uint32_t* adj = (uint32_t*)LODAlloc( sizeof(uint32_t) * 2, dl->numverts );
+    uint8_t* done = NULL;
+    lodout_t* merged = NULL;
+    uint32_t between[MAX_RUN];
+    uint32_t numLines = 0, numMerged = 0, i = 0, v = 0;
+
+    // Merge vertexes too close together to tell apart. Map vertexes are
+    // whole units, so there's nothing to merge when zoomed in that far.
+    if ( tolerance >= 1.0 ) {
+        ClusterVerts( dl, tolerance, rep );
+    } else {
+        for ( v = 0; v < dl->numverts; ++v ) {
+            rep[v] = v;
+        }
+    }
+    for ( i = 0; i < dl->numlines; ++i ) {
+        lines[i].v1 = rep[dl->lines[i].v1];
+        lines[i].v2 = rep[dl->lines[i].v2];
+        lines[i].first = i;
+        lines[i].style = dl->lines[i].style;
+    }
+    numLines = DropLines( lines, dl->numlines );
+
+    // Lines merged into a point are still drawn as a dot, unless another
+    // line already covers it
+    for ( i = 0; i < numLines; ++i ) {
+        if ( lines[i].v1 != lines[i].v2 ) {
+            ++degree[lines[i].v1];
+            ++degree[lines[i].v2];
+        }
+    }
+    for ( i = 0, v = 0; i < numLines; ++i ) {
+        if ( lines[i].v1 != lines[i].v2 || degree[lines[i].v1] == 0 ) {
+            lines[v++] = lines[i];
+        }
+    }
+    numLines = v;
+    memset( degree, 0, sizeof(uint32_t) * dl->numverts );
+
+    // Find the lines at each vertex. Only vertexes with two lines can be
+    // in the middle of a run, so only two are kept. Dots count twice so
+    // they're never in a run.
+    for ( i = 0; i < numLines; ++i ) {
+        uint32_t ends[2], e = 0;
+        ends[0] = lines[i].v1;
+        ends[1] = lines[i].v2;
+        for ( e = 0; e < 2; ++e ) {
+            if ( degree[ends[e]] < 2 ) {
+                adj[ends[e] * 2 + degree[ends[e]]] = i;
+            }
+            ++degree[ends[e]];
+        }
+    }
+    // A run can only pass through a vertex joining two lines of one style
+    #define JOINT(v) (degree[v] == 2 && \
+                      lines[adj[(v) * 2]].style == lines[adj[(v) * 2 + 1]].style)
+    #define OTHER_LINE(v, l) ((adj[(v) * 2] == (l)) ? adj[(v) * 2 + 1] : adj[(v) * 2])
+    #define OTHER_VERT(l, v) ((lines[l].v1 == (v)) ? lines[l].v2 : lines[l].v1)
+
+    // Walk each run of lines from one end to the other, merging as much as
+    // stays straight
+    done = (uint8_t*)LODAlloc( 1, numLines );
+    merged = (lodout_t*)LODAlloc( sizeof(lodout_t), numLines );
+    for ( i = 0; i < numLines; ++i ) {
+        uint32_t line = i, start = lines[i].v1, s = 0, j = 0, steps = 0, numBetween = 0;
+        uint32_t first = 0;
+        if ( done[i] ) {
+            continue;
+        }
+        // Back up to the start of the run, or all the way round a loop
+        while ( JOINT(start) && steps++ < numLines ) {
+            uint32_t prev = OTHER_LINE( start, line );
+            if ( prev == i ) {
+                break;
+            }
+            start = OTHER_VERT( prev, start );
+            line = prev;
+        }
+
+        s = start;
+        j = OTHER_VERT( line, s );
+        first = lines[line].first;
+        done[line] = 1;
+        for ( ;; ) {
+            uint32_t next = JOINT(j) ? OTHER_LINE( j, line ) : line;
+            uint32_t e = 0;
+            uint8_t last = (next == line || done[next]);
+            if ( !last ) {
+                e = OTHER_VERT( next, j );
+                between[numBetween] = j;
+                if ( numBetween + 1 < MAX_RUN &&
+                     IsStraight( dl->verts, s, e, between, numBetween + 1, tolerance ) ) {
+                    // Keep going with the longer line
+                    ++numBetween;
+                    if ( lines[next].first < first ) {
+                        first = lines[next].first;
+                    }
+                    line = next;
+                    j = e;
+                    done[line] = 1;
+                    continue;
+                }
+            }
+            // Finish the line at j
+            merged[numMerged].line.v1 = s;
+            merged[numMerged].line.v2 = j;
+            merged[numMerged].line.style = lines[line].style;
+            merged[numMerged].first = first;
+            ++numMerged;
+            if ( last ) {
+                break;
+            }
+            // And start a new one
+            s = j;
+            numBetween = 0;
+            line = next;
+            first = lines[line].first;
+            j = e;
+            done[line] = 1;
+        }
+    }
+    #undef JOINT
+    #undef OTHER_LINE
+    #undef OTHER_VERT
+
+    // Put the lines back in about the order they were in
+    qsort( merged, numMerged, sizeof(lodout_t), CompareOut );
+
+    memset( out, 0, sizeof(displaylist_t) );
+    memcpy( out->name, dl->name, sizeof(out->name) );
+    out->width = dl->width;
+    out->height = dl->height;
+    out->centerv = dl->centerv;
+    out->numverts = dl->numverts;
+    out->verts = (vertex_t*)LODAlloc( sizeof(vertex_t), dl->numverts );
+    memcpy( out->verts, dl->verts, sizeof(vertex_t) * dl->numverts );
+    out->numlines = numMerged;
+    out->lines = (dlline_t*)LODAlloc( sizeof(dlline_t), numMerged );
+    for ( i = 0; i < numMerged; ++i ) {
+        out->lines[i] = merged[i].line;
+    }
+    out->nummarkers = dl->nummarkers;
+    out->markers = (dlmarker_t*)LODAlloc( sizeof(dlmarker_t), dl->nummarkers );
+    memcpy( out->markers, dl->markers, sizeof(dlmarker_t) * dl->nummarkers );
+    DL_SortByStyle( out );
+
+    free( merged );
+    free( done );
+    free( adj );
+    free( degree );
+    free( lines );
+    free( rep );
+    return numMerged;
+}
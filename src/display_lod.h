@@ -0,0 +1,27 @@
+/*
+** display_lod.h
+**
+** Simplifies a display list for drawing at a small scale
+*/
+
+#ifndef __DISPLAY_LOD_H
+#define __DISPLAY_LOD_H
+
+#include "shared.h"
+#include "display_list.h"
+
+// How far in pixels a vertex may move when simplifying
+#define LOD_TOLERANCE 0.25
+
+/*
+** Make a simplified copy of a display list for drawing at scale pixels per
+** map unit. Vertexes closer together than a fraction of a pixel are
+** merged, which turns lines shorter than that into dots, and runs of
+** lines of the same style that are straight to within a fraction of a
+** pixel become one line. This is lossy: merged lines are drawn where the
+** first of them was, so overlaps and anti-aliasing can come out a little
+** different. Returns the number of lines left.
+*/
+uint32_t DL_Simplify( displaylist_t* out, const displaylist_t* dl, double scale );
+
+#endif
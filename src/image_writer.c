@@ -0,0 +1,347 @@
+/*
+** image_writer.c
+**
+** Streaming RGBA image output in PNG, QOI, binary PPM or raw form
+*/
+
+#include "image_writer.h"
+#include "buf_writer.h"
+#include "phase_stats.h"
+#include <png.h>
+
+// QOI chunk tags
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+
+struct imagestream_s {
+    imageformat_t format;
+    uint32_t      width, height;
+    outsink_t     sink;
+    FILE*         f; // File opened by IMG_Begin, NULL when writing to a sink
+    // PNG
+    png_structp   png;
+    png_infop     info;
+    // Everything else goes through a buffered writer, one encoded row at
+    // a time
+    bufwriter_t*  bw;
+    uint8_t*      row;
+    // QOI encoder state, which carries on from row to row
+    uint8_t       prev[4];
+    uint8_t       index[64][4];
+    uint32_t      run;
+};
+
+static const char* const formatNames[IMG_NUMFORMATS] = {"png", "qoi", "ppm", "raw"};
+static const char* const formatExtensions[IMG_NUMFORMATS] = {"png", "qoi", "ppm", "rgba"};
+
+imageformat_t IMG_FormatByName( const char* name ) {
+    uint32_t f = 0;
+
+    for ( f = 0; f < IMG_NUMFORMATS; ++f ) {
+        if ( strcmp( name, formatNames[f] ) == 0 ) {
+            break;
+        }
+    }
+    return (imageformat_t)f;
+}
+
+const char* IMG_Extension( imageformat_t format ) {
+    return formatExtensions[format];
+}
+
+// Pass libpng's output on to the sink
+static void WritePNGData( png_structp png, png_bytep data, png_size_t len ) {
+    imagestream_t* is = (imagestream_t*)png_get_io_ptr( png );
+
+    if ( !is->sink.write( is->sink.ctx, data, len ) ) {
+        png_error( png, "Write failed" );
+    }
+}
+
+static void FlushPNGData( png_structp png ) {
+    (void)png;
+}
+
+// Start a PNG image, returns 0 on failure
+static uint8_t BeginPNG( imagestream_t* volatile is ) {
+    is->png = png_create_write_struct( PNG_LIBPNG_VER_STRING, NULL, NULL, NULL );
+    if ( is->png != NULL ) {
+        is->info = png_create_info_struct( is->png );
+    }
+    if ( is->info == NULL || setjmp( png_jmpbuf( is->png ) ) ) {
+        return 0;
+    }
+    png_set_write_fn( is->png, is, WritePNGData, FlushPNGData );
+    // Every pixel is opaque, so the file is RGB and libpng drops the
+    // fourth byte of each pixel as it writes the rows
+    png_set_IHDR( is->png, is->info, is->width, is->height, 8, PNG_COLOR_TYPE_RGB,
+                  PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                  PNG_FILTER_TYPE_DEFAULT );
+    png_write_info( is->png, is->info );
+    png_set_filler( is->png, 0, PNG_FILLER_AFTER );
+    return 1;
+}
+
+// Finish a PNG image, returns 0 on failure
+static uint8_t EndPNG( imagestream_t* is ) {
+    volatile uint8_t ok = 1;
+
+    if ( is->info != NULL ) {
+        if ( setjmp( png_jmpbuf( is->png ) ) ) {
+            ok = 0;
+        } else {
+            png_write_end( is->png, is->info );
+        }
+    } else {
+        ok = 0;
+    }
+    png_destroy_write_struct( &is->png, &is->info );
+    return ok;
+}
+
+static void PutBE32( uint8_t* p, uint32_t v ) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+// Write a file header for the formats that have one
+static void WriteHeader( imagestream_t* is ) {
+    char header[64] = "";
+
+    if ( is->format == IMG_QOI ) {
+        uint8_t* h = (uint8_t*)header;
+        memcpy( h, "qoif", 4 );
+        PutBE32( h + 4, is->width );
+        PutBE32( h + 8, is->height );
+        h[12] = 4; // RGBA
+        h[13] = 0; // sRGB with linear alpha
+        BW_Write( is->bw, header, 14 );
+    } else if ( is->format == IMG_PPM ) {
+        snprintf( header, sizeof(header), "P6\n%u %u\n255\n", is->width, is->height );
+        BW_PutStr( is->bw, header );
+    }
+}
+
+/*
+** Start writing an image file
+*/
+imagestream_t* IMG_Begin( const char* filename, imageformat_t format,
+                          uint32_t width, uint32_t height ) {
+    FILE* f = fopen( filename, "wb" );
+    outsink_t sink;
+    imagestream_t* is = NULL;
+
+    if ( f == NULL ) {
+        return NULL;
+    }
+    sink = Sink_File( f );
+    is = IMG_BeginSink( &sink, format, width, height );
+    if ( is == NULL ) {
+        fclose( f );
+        return NULL;
+    }
+    is->f = f;
+    return is;
+}
+
+/*
+** Start writing an image to a sink
+*/
+imagestream_t* IMG_BeginSink( const outsink_t* sink, imageformat_t format,
+                              uint32_t width, uint32_t height ) {
+    imagestream_t* is = (imagestream_t*)calloc( 1, sizeof(imagestream_t) );
+
+    if ( is == NULL ) {
+        return NULL;
+    }
+    Stats_AddAlloc();
+    is->format = format;
+    is->width = width;
+    is->height = height;
+    is->sink = *sink;
+    if ( format == IMG_PNG ) {
+        if ( !BeginPNG( is ) ) {
+            IMG_End( is );
+            return NULL;
+        }
+        return is;
+    }
+
+    // A QOI pixel takes at most 5 bytes, a PPM one 3
+    if ( format != IMG_RAW ) {
+        is->row = (uint8_t*)malloc( (size_t)width * 5 + 1 );
+        if ( is->row == NULL ) {
+            free( is );
+            return NULL;
+        }
+    }
+    is->bw = BW_OpenSink( &is->sink );
+    if ( is->bw == NULL ) {
+        free( is->row );
+        free( is );
+        return NULL;
+    }
+    is->prev[3] = 255;
+    WriteHeader( is );
+    return is;
+}
+
+// Encode a row of pixels as QOI chunks, returns the encoded size
+static size_t EncodeQOIRow( imagestream_t* is, const uint8_t* px ) {
+    uint8_t* out = is->row;
+    uint8_t* prev = is->prev;
+    uint32_t x = 0;
+
+    for ( x = 0; x < is->width; ++x, px += 4 ) {
+        uint32_t h = 0;
+
+        if ( px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2] && px[3] == prev[3] ) {
+            // Runs can cross rows, they're only cut off at 62 pixels
+            if ( ++is->run == 62 ) {
+                *out++ = (uint8_t)(QOI_OP_RUN | (is->run - 1));
+                is->run = 0;
+            }
+            continue;
+        }
+        if ( is->run > 0 ) {
+            *out++ = (uint8_t)(QOI_OP_RUN | (is->run - 1));
+            is->run = 0;
+        }
+
+        h = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+        if ( memcmp( is->index[h], px, 4 ) == 0 ) {
+            *out++ = (uint8_t)(QOI_OP_INDEX | h);
+        } else if ( px[3] == prev[3] ) {
+            int8_t dr = (int8_t)(px[0] - prev[0]);
+            int8_t dg = (int8_t)(px[1] - prev[1]);
+            int8_t db = (int8_t)(px[2] - prev[2]);
+            int8_t drg = (int8_t)(dr - dg), dbg = (int8_t)(db - dg);
+
+            memcpy( is->index[h], px, 4 );
+            if ( dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1 ) {
+                *out++ = (uint8_t)(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+            } else if ( dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 &&
+                        dbg >= -8 && dbg <= 7 ) {
+                *out++ = (uint8_t)(QOI_OP_LUMA | (dg + 32));
+                *out++ = (uint8_t)((drg + 8) << 4 | (dbg + 8));
+            } else {
+                *out++ = QOI_OP_RGB;
+                *out++ = px[0];
+                *out++ = px[1];
+                *out++ = px[2];
+            }
+        } else {
+            memcpy( is->index[h], px, 4 );
+            *out++ = QOI_OP_RGBA;
+            memcpy( out, px, 4 );
+            out += 4;
+        }
+        memcpy( prev, px, 4 );
+    }
+    return (size_t)(out - is->row);
+}
+
+// Drop the alpha from a row of pixels for PPM, returns the encoded size
+static size_t EncodePPMRow( imagestream_t* is, const uint8_t* px ) {
+    uint8_t* out = is->row;
+    uint32_t x = 0;
+
+    for ( x = 0; x < is->width; ++x, px += 4, out += 3 ) {
+        out[0] = px[0];
+        out[1] = px[1];
+        out[2] = px[2];
+    }
+    return (size_t)is->width * 3;
+}
+
+/*
+** Write the next rows of RGBA pixels
+*/
+uint8_t IMG_WriteRows( imagestream_t* is, const uint8_t* rows, uint32_t numRows ) {
+    size_t stride = (size_t)is->width * 4;
+    uint32_t y = 0;
+
+    if ( is->format == IMG_PNG ) {
+        if ( setjmp( png_jmpbuf( is->png ) ) ) {
+            return 0;
+        }
+        for ( y = 0; y < numRows; ++y ) {
+            png_write_row( is->png, rows + y * stride );
+        }
+        return 1;
+    }
+    if ( is->format == IMG_RAW ) {
+        BW_Write( is->bw, (const char*)rows, stride * numRows );
+        return !is->bw->failed;
+    }
+    for ( y = 0; y < numRows; ++y ) {
+        size_t len = (is->format == IMG_QOI) ? EncodeQOIRow( is, rows + y * stride )
+                                             : EncodePPMRow( is, rows + y * stride );
+        BW_Write( is->bw, (const char*)is->row, len );
+    }
+    return !is->bw->failed;
+}
+
+/*
+** Finish the image file and free the stream
+*/
+uint8_t IMG_End( imagestream_t* is ) {
+    static const char qoiEnd[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    uint8_t ok = 1;
+
+    if ( is->format == IMG_PNG ) {
+        ok = EndPNG( is );
+    } else {
+        if ( is->format == IMG_QOI ) {
+            if ( is->run > 0 ) {
+                BW_PutChar( is->bw, (char)(QOI_OP_RUN | (is->run - 1)) );
+            }
+            BW_Write( is->bw, qoiEnd, sizeof(qoiEnd) );
+        }
+        ok = BW_Close( is->bw );
+        free( is->row );
+    }
+    if ( is->f != NULL && fclose( is->f ) != 0 ) {
+        ok = 0;
+    }
+    free( is );
+    return ok;
+}
+
+/*
+** Write a whole image of RGBA pixels to a file
+*/
+uint8_t IMG_Write( const char* filename, imageformat_t format, const uint8_t* pixels,
+                   uint32_t width, uint32_t height ) {
+    FILE* f = fopen( filename, "wb" );
+    outsink_t sink;
+    uint8_t ok = 0;
+
+    if ( f == NULL ) {
+        return 0;
+    }
+    sink = Sink_File( f );
+    ok = IMG_WriteSink( &sink, format, pixels, width, height );
+    return (fclose( f ) == 0) && ok;
+}
+
+/*
+** Write a whole image of RGBA pixels to a sink
+*/
+uint8_t IMG_WriteSink( const outsink_t* sink, imageformat_t format, const uint8_t* pixels,
+                       uint32_t width, uint32_t height ) {
+    imagestream_t* is = IMG_BeginSink( sink, format, width, height );
+    uint8_t ok = 0;
+
+    if ( is == NULL ) {
+        return 0;
+    }
+    ok = IMG_WriteRows( is, pixels, height );
+    return IMG_End( is ) && ok;
+}
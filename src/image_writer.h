@@ -0,0 +1,71 @@
+/*
+** image_writer.h
+**
+** Streaming RGBA image output in PNG, QOI, binary PPM or raw form
+*/
+
+#ifndef __IMAGE_WRITER_H
+#define __IMAGE_WRITER_H
+
+#include "shared.h"
+#include "out_sink.h"
+
+// Image file formats
+typedef enum {
+    IMG_PNG, // Deflate compressed, for final output
+    IMG_QOI, // Quite OK Image, a fast run length and delta coding
+    IMG_PPM, // Binary PPM (P6), uncompressed RGB
+    IMG_RAW, // Raw RGBA pixels with no header
+    IMG_NUMFORMATS
+} imageformat_t;
+
+// An image file being written a few rows at a time
+typedef struct imagestream_s imagestream_t;
+
+/*
+** Get a format from its name, e.g. "qoi". Returns IMG_NUMFORMATS if there's
+** no such format.
+*/
+imageformat_t IMG_FormatByName( const char* name );
+
+/*
+** Get the file extension of a format, without the dot
+*/
+const char* IMG_Extension( imageformat_t format );
+
+/*
+** Start writing an image file. Returns NULL on failure.
+*/
+imagestream_t* IMG_Begin( const char* filename, imageformat_t format,
+                          uint32_t width, uint32_t height );
+
+/*
+** Start writing an image to a sink. Returns NULL on failure.
+*/
+imagestream_t* IMG_BeginSink( const outsink_t* sink, imageformat_t format,
+                              uint32_t width, uint32_t height );
+
+/*
+** Write the next numRows rows of RGBA pixels. Returns 0 on failure.
+*/
+uint8_t IMG_WriteRows( imagestream_t* is, const uint8_t* rows, uint32_t numRows );
+
+/*
+** Finish the image and free the stream, closing the file if IMG_Begin
+** opened one. Returns 0 on failure.
+*/
+uint8_t IMG_End( imagestream_t* is );
+
+/*
+** Write a whole image of RGBA pixels to a file. Returns 0 on failure.
+*/
+uint8_t IMG_Write( const char* filename, imageformat_t format, const uint8_t* pixels,
+                   uint32_t width, uint32_t height );
+
+/*
+** Write a whole image of RGBA pixels to a sink. Returns 0 on failure.
+*/
+uint8_t IMG_WriteSink( const outsink_t* sink, imageformat_t format, const uint8_t* pixels,
+                       uint32_t width, uint32_t height );
+
+#endif
@@ -0,0 +1,179 @@
+/*
+** line_specials.c
+**
+** Classifying linedef specials, including Boom generalized specials
+*/
+
+#include "line_specials.h"
+
+// Pack a category and key into one table entry
+#define KEYED(cat, key) ((cat) | ((key) << 4))
+
+// Number of entries in the table of numbered specials
+#define NUM_SPECIALS 273
+
+// Category and key of every numbered special, vanilla and Boom
+static const uint8_t specialTable[NUM_SPECIALS] = {
+    // Doors
+    [1] = SC_DOOR, [2] = SC_DOOR, [3] = SC_DOOR, [4] = SC_DOOR, [16] = SC_DOOR,
+    [29] = SC_DOOR, [31] = SC_DOOR, [42] = SC_DOOR, [46] = SC_DOOR,
+    [50] = SC_DOOR, [61] = SC_DOOR, [63] = SC_DOOR, [75] = SC_DOOR,
+    [76] = SC_DOOR, [86] = SC_DOOR, [90] = SC_DOOR, [103] = SC_DOOR,
+    [105] = SC_DOOR, [106] = SC_DOOR, [107] = SC_DOOR, [108] = SC_DOOR,
+    [109] = SC_DOOR, [110] = SC_DOOR, [111] = SC_DOOR, [112] = SC_DOOR,
+    [113] = SC_DOOR, [114] = SC_DOOR, [115] = SC_DOOR, [116] = SC_DOOR,
+    [117] = SC_DOOR, [118] = SC_DOOR, [175] = SC_DOOR, [196] = SC_DOOR,
+    // Floors
+    [5] = SC_FLOOR, [18] = SC_FLOOR, [19] = SC_FLOOR, [23] = SC_FLOOR,
+    [24] = SC_FLOOR, [30] = SC_FLOOR, [36] = SC_FLOOR, [37] = SC_FLOOR,
+    [38] = SC_FLOOR, [45] = SC_FLOOR, [55] = SC_FLOOR, [56] = SC_FLOOR,
+    [58] = SC_FLOOR, [59] = SC_FLOOR, [60] = SC_FLOOR, [64] = SC_FLOOR,
+    [65] = SC_FLOOR, [69] = SC_FLOOR, [70] = SC_FLOOR, [71] = SC_FLOOR,
+    [78] = SC_FLOOR, [82] = SC_FLOOR, [83] = SC_FLOOR, [84] = SC_FLOOR,
+    [91] = SC_FLOOR, [92] = SC_FLOOR, [93] = SC_FLOOR, [94] = SC_FLOOR,
+    [96] = SC_FLOOR, [98] = SC_FLOOR, [101] = SC_FLOOR, [102] = SC_FLOOR,
+    [119] = SC_FLOOR, [128] = SC_FLOOR, [129] = SC_FLOOR, [130] = SC_FLOOR,
+    [131] = SC_FLOOR, [132] = SC_FLOOR, [140] = SC_FLOOR, [142] = SC_FLOOR,
+    [147] = SC_FLOOR, [153] = SC_FLOOR, [154] = SC_FLOOR, [158] = SC_FLOOR,
+    [159] = SC_FLOOR, [160] = SC_FLOOR, [161] = SC_FLOOR, [176] = SC_FLOOR,
+    [177] = SC_FLOOR, [178] = SC_FLOOR, [179] = SC_FLOOR, [180] = SC_FLOOR,
+    [189] = SC_FLOOR, [190] = SC_FLOOR, [219] = SC_FLOOR, [220] = SC_FLOOR,
+    [221] = SC_FLOOR, [222] = SC_FLOOR, [239] = SC_FLOOR, [240] = SC_FLOOR,
+    [241] = SC_FLOOR,
+    // Ceilings
+    [40] = SC_CEILING, [41] = SC_CEILING, [43] = SC_CEILING, [44] = SC_CEILING,
+    [72] = SC_CEILING, [145] = SC_CEILING, [151] = SC_CEILING,
+    [152] = SC_CEILING, [166] = SC_CEILING, [167] = SC_CEILING,
+    [186] = SC_CEILING, [187] = SC_CEILING, [199] = SC_CEILING,
+    [200] = SC_CEILING, [201] = SC_CEILING, [202] = SC_CEILING,
+    [203] = SC_CEILING, [204] = SC_CEILING, [205] = SC_CEILING,
+    [206] = SC_CEILING,
+    // Platforms
+    [10] = SC_LIFT, [14] = SC_LIFT, [15] = SC_LIFT, [20] = SC_LIFT,
+    [21] = SC_LIFT, [22] = SC_LIFT, [47] = SC_LIFT, [53] = SC_LIFT,
+    [54] = SC_LIFT, [62] = SC_LIFT, [66] = SC_LIFT, [67] = SC_LIFT,
+    [68] = SC_LIFT, [87] = SC_LIFT, [88] = SC_LIFT, [89] = SC_LIFT,
+    [95] = SC_LIFT, [120] = SC_LIFT, [121] = SC_LIFT, [122] = SC_LIFT,
+    [123] = SC_LIFT, [143] = SC_LIFT, [144] = SC_LIFT, [148] = SC_LIFT,
+    [149] = SC_LIFT, [162] = SC_LIFT, [163] = SC_LIFT, [181] = SC_LIFT,
+    [182] = SC_LIFT, [211] = SC_LIFT, [212] = SC_LIFT,
+    // Crushers
+    [6] = SC_CRUSHER, [25] = SC_CRUSHER, [49] = SC_CRUSHER, [57] = SC_CRUSHER,
+    [73] = SC_CRUSHER, [74] = SC_CRUSHER, [77] = SC_CRUSHER, [141] = SC_CRUSHER,
+    [150] = SC_CRUSHER, [164] = SC_CRUSHER, [165] = SC_CRUSHER,
+    [168] = SC_CRUSHER, [183] = SC_CRUSHER, [184] = SC_CRUSHER,
+    [185] = SC_CRUSHER, [188] = SC_CRUSHER,
+    // Stair builders
+    [7] = SC_STAIRS, [8] = SC_STAIRS, [100] = SC_STAIRS, [127] = SC_STAIRS,
+    [256] = SC_STAIRS, [257] = SC_STAIRS, [258] = SC_STAIRS, [259] = SC_STAIRS,
+    // Elevators
+    [227] = SC_ELEVATOR, [228] = SC_ELEVATOR, [229] = SC_ELEVATOR,
+    [230] = SC_ELEVATOR, [231] = SC_ELEVATOR, [232] = SC_ELEVATOR,
+    [233] = SC_ELEVATOR, [234] = SC_ELEVATOR, [235] = SC_ELEVATOR,
+    [236] = SC_ELEVATOR, [237] = SC_ELEVATOR, [238] = SC_ELEVATOR,
+    // Lighting
+    [12] = SC_LIGHT, [13] = SC_LIGHT, [17] = SC_LIGHT, [35] = SC_LIGHT,
+    [79] = SC_LIGHT, [80] = SC_LIGHT, [81] = SC_LIGHT, [104] = SC_LIGHT,
+    [138] = SC_LIGHT, [139] = SC_LIGHT, [156] = SC_LIGHT, [157] = SC_LIGHT,
+    [169] = SC_LIGHT, [170] = SC_LIGHT, [171] = SC_LIGHT, [172] = SC_LIGHT,
+    [173] = SC_LIGHT, [192] = SC_LIGHT, [193] = SC_LIGHT, [194] = SC_LIGHT,
+    // Exits
+    [11] = SC_EXIT, [51] = SC_EXIT, [52] = SC_EXIT, [124] = SC_EXIT,
+    [197] = SC_EXIT, [198] = SC_EXIT,
+    // Teleporters
+    [39] = SC_TELEPORT, [97] = SC_TELEPORT, [125] = SC_TELEPORT,
+    [126] = SC_TELEPORT, [174] = SC_TELEPORT, [195] = SC_TELEPORT,
+    [207] = SC_TELEPORT, [208] = SC_TELEPORT, [209] = SC_TELEPORT,
+    [210] = SC_TELEPORT, [243] = SC_TELEPORT, [244] = SC_TELEPORT,
+    [262] = SC_TELEPORT, [263] = SC_TELEPORT, [264] = SC_TELEPORT,
+    [265] = SC_TELEPORT, [266] = SC_TELEPORT, [267] = SC_TELEPORT,
+    [268] = SC_TELEPORT, [269] = SC_TELEPORT,
+    // Donuts
+    [9] = SC_DONUT, [146] = SC_DONUT, [155] = SC_DONUT, [191] = SC_DONUT,
+    // Blue locked doors
+    [26] = KEYED(SC_DOOR, KEY_BLUE), [32] = KEYED(SC_DOOR, KEY_BLUE),
+    [99] = KEYED(SC_DOOR, KEY_BLUE), [133] = KEYED(SC_DOOR, KEY_BLUE),
+    // Red locked doors
+    [28] = KEYED(SC_DOOR, KEY_RED), [33] = KEYED(SC_DOOR, KEY_RED),
+    [134] = KEYED(SC_DOOR, KEY_RED), [135] = KEYED(SC_DOOR, KEY_RED),
+    // Yellow locked doors
+    [27] = KEYED(SC_DOOR, KEY_YELLOW), [34] = KEYED(SC_DOOR, KEY_YELLOW),
+    [136] = KEYED(SC_DOOR, KEY_YELLOW), [137] = KEYED(SC_DOOR, KEY_YELLOW),
+    // Scrollers, light and sky transfers, friction, wind and other effects
+    [48] = SC_EFFECT, [85] = SC_EFFECT, [213] = SC_EFFECT, [223] = SC_EFFECT,
+    [224] = SC_EFFECT, [225] = SC_EFFECT, [226] = SC_EFFECT, [242] = SC_EFFECT,
+    [245] = SC_EFFECT, [246] = SC_EFFECT, [247] = SC_EFFECT, [248] = SC_EFFECT,
+    [249] = SC_EFFECT, [250] = SC_EFFECT, [251] = SC_EFFECT, [252] = SC_EFFECT,
+    [253] = SC_EFFECT, [254] = SC_EFFECT, [255] = SC_EFFECT, [260] = SC_EFFECT,
+    [261] = SC_EFFECT, [271] = SC_EFFECT, [272] = SC_EFFECT
+};
+
+// Start of each range of Boom generalized specials
+#define GEN_CRUSHER 0x2F80
+#define GEN_STAIRS  0x3000
+#define GEN_LIFT    0x3400
+#define GEN_LOCKED  0x3800
+#define GEN_DOOR    0x3C00
+#define GEN_CEILING 0x4000
+#define GEN_FLOOR   0x6000
+#define GEN_END     0x8000 // Past the last one, higher values are negative in the WAD
+
+// Category names, in specialcat_t order
+static const char* categoryNames[SC_NUMCATEGORIES] = {
+    "None", "Door", "Floor", "Ceiling", "Lift", "Crusher", "Stairs",
+    "Elevator", "Light", "Exit", "Teleport", "Donut", "Effect"
+};
+
+// Key needed by a generalized locked door
+static specialkey_t LockedDoorKey( uint16_t special ) {
+    // Bits 6 to 8 pick the key, cards and skulls are treated the same
+    switch ( (special & 0x01C0) >> 6 ) {
+        case 0: return KEY_ANY;
+        case 1: case 4: return KEY_RED;
+        case 2: case 5: return KEY_BLUE;
+        case 3: case 6: return KEY_YELLOW;
+        default: return KEY_ALL;
+    }
+}
+
+/*
+** Classify a linedef special
+*/
+specialclass_t ClassifySpecial( uint16_t special ) {
+    specialclass_t sc = {SC_NONE, KEY_NONE, 0};
+
+    if ( special < NUM_SPECIALS ) {
+        sc.category = specialTable[special] & 0x0F;
+        sc.key = specialTable[special] >> 4;
+        return sc;
+    }
+    if ( special < GEN_CRUSHER || special >= GEN_END ) {
+        return sc;
+    }
+    // Boom generalized specials, from highest range down
+    sc.generalized = 1;
+    if ( special >= GEN_FLOOR ) {
+        sc.category = SC_FLOOR;
+    } else if ( special >= GEN_CEILING ) {
+        sc.category = SC_CEILING;
+    } else if ( special >= GEN_DOOR ) {
+        sc.category = SC_DOOR;
+    } else if ( special >= GEN_LOCKED ) {
+        sc.category = SC_DOOR;
+        sc.key = LockedDoorKey( special );
+    } else if ( special >= GEN_LIFT ) {
+        sc.category = SC_LIFT;
+    } else if ( special >= GEN_STAIRS ) {
+        sc.category = SC_STAIRS;
+    } else {
+        sc.category = SC_CRUSHER;
+    }
+    return sc;
+}
+
+/*
+** Get the name of a special category
+*/
+const char* GetSpecialCategoryName( specialcat_t category ) {
+    return (category < SC_NUMCATEGORIES) ? categoryNames[category] : "Unknown";
+}
@@ -0,0 +1,57 @@
+/*
+** line_specials.h
+**
+** Classifying linedef specials, including Boom generalized specials
+*/
+
+#ifndef __LINE_SPECIALS_H
+#define __LINE_SPECIALS_H
+
+#include "shared.h"
+
+// What a special does
+typedef enum {
+    SC_NONE,     // No special or an unknown one
+    SC_DOOR,     // Doors, including locked doors
+    SC_FLOOR,    // Floor movers
+    SC_CEILING,  // Ceiling movers
+    SC_LIFT,     // Lifts and platforms
+    SC_CRUSHER,  // Crushers
+    SC_STAIRS,   // Stair builders
+    SC_ELEVATOR, // Elevators
+    SC_LIGHT,    // Light changers
+    SC_EXIT,     // Level exits
+    SC_TELEPORT, // Teleporters
+    SC_DONUT,    // Donuts
+    SC_EFFECT,   // Passive effects like scrollers, not triggered by the player
+    SC_NUMCATEGORIES
+} specialcat_t;
+
+// Key needed to use a special
+typedef enum {
+    KEY_NONE,   // No key needed
+    KEY_BLUE,   // Blue card or skull
+    KEY_RED,    // Red card or skull
+    KEY_YELLOW, // Yellow card or skull
+    KEY_ANY,    // Any key
+    KEY_ALL     // All keys
+} specialkey_t;
+
+// A classified special
+typedef struct {
+    uint8_t category;    // specialcat_t
+    uint8_t key;         // specialkey_t
+    uint8_t generalized; // Is it a Boom generalized special?
+} specialclass_t;
+
+/*
+** Classify a linedef special. Takes constant time.
+*/
+specialclass_t ClassifySpecial( uint16_t special );
+
+/*
+** Get the name of a special category
+*/
+const char* GetSpecialCategoryName( specialcat_t category );
+
+#endif
@@ -0,0 +1,245 @@
+/*
+** lump_index.c
+**
+** Hashed index over the lump directory for fast lookups by name
+*/
+
+#include "lump_index.h"
+#include "phase_stats.h"
+
+// Hash a packed lump name into a slot number of a table with 2^bits slots.
+// The top bits of the product are the ones every byte of the name reaches.
+#define HASH_KEY(k, bits) ((uint32_t)(((k) * 0x9E3779B97F4A7C15ULL) >> (64 - (bits))))
+
+/*
+** Pack a lump name into a 64 bit key
+*/
+uint64_t WAD_LumpKey( const char* name ) {
+    uint64_t key = 0;
+    uint8_t n = 0;
+    for ( n = 0; n < 8 && name[n] != '\0'; ++n ) {
+        uint8_t c = (uint8_t)name[n];
+        // Uppercase
+        if ( c >= 'a' && c <= 'z' ) {
+            c -= 'a' - 'A';
+        }
+        key |= (uint64_t)c << (n * 8);
+    }
+    return key;
+}
+
+// Find the slot for a key, either the one holding it or the empty one
+// where it would go
+static uint32_t* FindSlot( const lumpindex_t* index, uint64_t key ) {
+    uint32_t mask = index->numslots - 1;
+    uint32_t s = HASH_KEY( key, __builtin_ctz( index->numslots ) );
+    while ( index->slots[s] != LUMP_NONE &&
+            WAD_LumpKey( index->lumps[index->slots[s]].name ) != key ) {
+        s = (s + 1) & mask;
+    }
+    return &index->slots[s];
+}
+
+/*
+** Build the index for all the lumps in a WAD
+*/
+void WAD_BuildLumpIndex( lumpindex_t* index, const wadfile_t* wad ) {
+    uint32_t l = 0;
+
+    // Keep the table at most half full, which caps it at 2^30 lumps (a 16 GB
+    // directory) for the slot count to fit in 32 bits
+    if ( wad->info.numlumps > 0x40000000 ) {
+        fprintf( stderr, "Error! Too many lumps to index: %u\n", wad->info.numlumps );
+        exit( EXIT_FAILURE );
+    }
+    index->numslots = LUMP_MIN_SLOTS;
+    while ( index->numslots < wad->info.numlumps * 2 ) {
+        index->numslots <<= 1;
+    }
+    index->slots = (uint32_t*)malloc( sizeof(uint32_t) * index->numslots );
+    index->numlumps = wad->info.numlumps;
+    index->next = (uint32_t*)malloc( sizeof(uint32_t) * ((size_t)index->numlumps + 1) );
+    index->lumps = wad->lumps;
+    if ( index->slots == NULL || index->next == NULL ) {
+        fprintf( stderr, "Error allocating lump index!\n" );
+        exit( EXIT_FAILURE );
+    }
+    Stats_AddAlloc(); // The slots
+    Stats_AddAlloc(); // and the chains
+    memset( index->slots, 0xFF, sizeof(uint32_t) * index->numslots );
+
+    for ( l = 0; l < index->numlumps; ++l ) {
+        uint64_t key = WAD_LumpKey( wad->lumps[l].name );
+        uint32_t* slot = NULL;
+
+        // Nameless lumps can't be looked up, they're a chain of their own
+        index->next[l] = l;
+        if ( key == 0 ) {
+            continue;
+        }
+        slot = FindSlot( index, key );
+        if ( *slot != LUMP_NONE ) {
+            // Chain on after the previous last lump with this name
+            index->next[l] = index->next[*slot];
+            index->next[*slot] = l;
+        }
+        *slot = l;
+    }
+}
+
+/*
+** Free the index
+*/
+void WAD_FreeLumpIndex( lumpindex_t* index ) {
+    free( index->slots );
+    free( index->next );
+    index->slots = NULL;
+    index->next = NULL;
+    index->lumps = NULL;
+    index->numslots = index->numlumps = 0;
+}
+
+/*
+** Find the first lump with a name
+*/
+uint32_t WAD_FindFirstLump( const lumpindex_t* index, const char* name ) {
+    uint32_t last = WAD_FindLastLump( index, name );
+    return (last != LUMP_NONE) ? index->next[last] : LUMP_NONE;
+}
+
+/*
+** Find the last lump with a name
+*/
+uint32_t WAD_FindLastLump( const lumpindex_t* index, const char* name ) {
+    uint64_t key = WAD_LumpKey( name );
+    if ( key == 0 || index->slots == NULL ) {
+        return LUMP_NONE;
+    }
+    return *FindSlot( index, key );
+}
+
+/*
+** Find the next lump after the given one that has the same name
+*/
+uint32_t WAD_FindNextLump( const lumpindex_t* index, uint32_t lump ) {
+    uint32_t next = 0;
+    if ( lump >= index->numlumps ) {
+        return LUMP_NONE;
+    }
+    // Going back to an earlier lump means it was the last one
+    next = index->next[lump];
+    return (next > lump) ? next : LUMP_NONE;
+}
+
+/*
+** Find the lumps between a pair of markers
+*/
+uint8_t WAD_FindLumpRange( const lumpindex_t* index, const char* start,
+                           const char* end, uint32_t* first, uint32_t* last ) {
+    uint32_t s = WAD_FindFirstLump( index, start );
+    uint32_t e = LUMP_NONE;
+
+    if ( s == LUMP_NONE ) {
+        return 0;
+    }
+    // Use the first end marker that comes after the start marker, which
+    // also keeps e - 1 from wrapping
+    e = WAD_FindFirstLump( index, end );
+    while ( e != LUMP_NONE && e <= s ) {
+        e = WAD_FindNextLump( index, e );
+    }
+    if ( e == LUMP_NONE ) {
+        return 0;
+    }
+    *first = s + 1;
+    *last = e - 1;
+    return 1;
+}
+
+// Names of the map lumps, in maplump_t order
+static const char* mapLumpNames[ML_NUMLUMPS] = {
+    "THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES", "SEGS", "SSECTORS",
+    "NODES", "SECTORS", "REJECT", "BLOCKMAP", "BEHAVIOR"
+};
+
+// Get which map lump a key is, or ML_NUMLUMPS if it isn't one
+static maplump_t ClassifyLump( const uint64_t* mapKeys, uint64_t key ) {
+    uint8_t m = 0;
+    for ( m = 0; m < ML_NUMLUMPS; ++m ) {
+        if ( mapKeys[m] == key ) {
+            break;
+        }
+    }
+    return (maplump_t)m;
+}
+
+/*
+** Find every map in a WAD
+*/
+uint32_t WAD_FindMaps( const wadfile_t* wad, mapblock_t** maps ) {
+    uint64_t mapKeys[ML_NUMLUMPS];
+    mapblock_t* block = NULL; // Map currently being filled in
+    mapblock_t* grown = NULL;
+    uint32_t numMaps = 0, capacity = 16, l = 0, kept = 0;
+    uint8_t m = 0;
+
+    for ( m = 0; m < ML_NUMLUMPS; ++m ) {
+        mapKeys[m] = WAD_LumpKey( mapLumpNames[m] );
+    }
+    *maps = (mapblock_t*)malloc( sizeof(mapblock_t) * capacity );
+    if ( *maps == NULL ) {
+        fprintf( stderr, "Error allocating map list!\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    for ( l = 1; l < wad->info.numlumps; ++l ) {
+        maplump_t kind = ClassifyLump( mapKeys, WAD_LumpKey( wad->lumps[l].name ) );
+
+        if ( kind == ML_NUMLUMPS ) {
+            block = NULL; // Any map block ends here
+            continue;
+        }
+        // A second lump of the same kind means a map without a marker
+        // between it and the last one, which we can't name, so skip it
+        if ( block != NULL && block->lumps[kind] != LUMP_NONE ) {
+            block = NULL;
+            continue;
+        }
+        if ( block == NULL ) {
+            // Only start a map right after a marker
+            if ( ClassifyLump( mapKeys, WAD_LumpKey( wad->lumps[l - 1].name ) ) != ML_NUMLUMPS ) {
+                continue;
+            }
+            if ( numMaps == capacity ) {
+                capacity *= 2;
+                grown = (mapblock_t*)realloc( *maps, sizeof(mapblock_t) * capacity );
+                if ( grown == NULL ) {
+                    fprintf( stderr, "Error allocating map list!\n" );
+                    exit( EXIT_FAILURE );
+                }
+                *maps = grown;
+            }
+            block = &(*maps)[numMaps++];
+            memcpy( block->name, wad->lumps[l - 1].name, 8 );
+            block->marker = l - 1;
+            for ( m = 0; m < ML_NUMLUMPS; ++m ) {
+                block->lumps[m] = LUMP_NONE;
+            }
+        }
+        block->lumps[kind] = l;
+    }
+
+    // Drop anything that doesn't have any map data we can use, moving the
+    // rest down in one pass
+    for ( l = 0; l < numMaps; ++l ) {
+        if ( (*maps)[l].lumps[ML_THINGS] == LUMP_NONE &&
+             (*maps)[l].lumps[ML_LINEDEFS] == LUMP_NONE ) {
+            continue;
+        }
+        if ( kept != l ) {
+            (*maps)[kept] = (*maps)[l];
+        }
+        ++kept;
+    }
+    return kept;
+}
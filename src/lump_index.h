@@ -0,0 +1,75 @@
+/*
+** lump_index.h
+**
+** Hashed index over the lump directory for fast lookups by name
+*/
+
+#ifndef __LUMP_INDEX_H
+#define __LUMP_INDEX_H
+
+#include "shared.h"
+
+// Smallest hash table, which keeps the hash shift below 64 bits
+#define LUMP_MIN_SLOTS 16
+
+// Lump name index. Lumps with the same name are chained together in
+// directory order, with the last one linking back round to the first, so
+// the table only needs to hold the last lump of each distinct name. The
+// names themselves are read from the directory.
+typedef struct {
+    uint32_t    numslots; // Size of the hash table, always a power of two
+    uint32_t*   slots;    // Last lump of each distinct name, LUMP_NONE if empty
+    uint32_t    numlumps; // Number of lumps indexed
+    uint32_t*   next;     // Next lump with the same name, for every lump
+    const lumpinfo_t* lumps; // The directory that's indexed
+} lumpindex_t;
+
+/*
+** Pack a lump name into a 64 bit key. The name ends at the first NUL or
+** after 8 characters and is compared case insensitively.
+*/
+uint64_t WAD_LumpKey( const char* name );
+
+/*
+** Build the index for all the lumps in a WAD. The WAD's directory has to
+** outlive the index.
+*/
+void WAD_BuildLumpIndex( lumpindex_t* index, const wadfile_t* wad );
+
+/*
+** Free the index
+*/
+void WAD_FreeLumpIndex( lumpindex_t* index );
+
+/*
+** Find the first lump with a name
+*/
+uint32_t WAD_FindFirstLump( const lumpindex_t* index, const char* name );
+
+/*
+** Find the last lump with a name. This is the one the game would use.
+*/
+uint32_t WAD_FindLastLump( const lumpindex_t* index, const char* name );
+
+/*
+** Find the next lump after the given one that has the same name
+*/
+uint32_t WAD_FindNextLump( const lumpindex_t* index, uint32_t lump );
+
+/*
+** Find the lumps between a pair of markers such as S_START and S_END.
+** first and last are set to the lumps just inside the markers. Markers
+** next to each other give an empty range, with first == last + 1. Returns
+** 0 if there's no start marker with an end marker after it.
+*/
+uint8_t WAD_FindLumpRange( const lumpindex_t* index, const char* start,
+                           const char* end, uint32_t* first, uint32_t* last );
+
+/*
+** Find every map in a WAD by looking for runs of map lumps (THINGS,
+** LINEDEFS, NODES, BEHAVIOR, ...) in any order, each one following its
+** marker. Allocates and fills in *maps and returns the number of maps.
+*/
+uint32_t WAD_FindMaps( const wadfile_t* wad, mapblock_t** maps );
+
+#endif
@@ -6,21 +6,126 @@
 
 #include "shared.h"
 #include "wad_reader.h"
+#include "wad_dir.h"
 #include "map_drawer.h"
+#include "worker_pool.h"
+#include "thing_counter.h"
+#include "wad_dump.h"
+#include "phase_stats.h"
+#include "trace.h"
+
+// Maps to load and draw in batch mode
+typedef struct {
+    wad_handle_t* wadhandle; // The open WAD file
+    wadfile_t*    wad;       // WAD info and lump info table
+    mapblock_t*   maps;      // Where the lumps of every map are
+    uint32_t      parts;     // Parts of each map to read
+    const drawsettings_t* settings; // How to draw the maps
+    maparena_t*   arenas;    // Memory for the maps, one arena per worker
+    mapstats_t*   stats;     // Stats of every map, reported in order at the end
+    uint32_t*     tiles;     // Tiles written for every map
+    statsrecord_t* records;  // Phase stats of every map, NULL if they're off
+} mapbatch_t;
 
 // Global configuration file
 dictionary* ini = NULL;
 
+// Name the output files after a map, without any path separators
+static void GetOutName( const char* name, char* outname ) {
+    uint8_t c = 0;
+
+    for ( c = 0; c < 8 && name[c] != '\0'; ++c ) {
+        outname[c] = (name[c] == '/' || name[c] == '\\') ? '_' : name[c];
+    }
+    outname[c] = '\0';
+}
+
+// Draw a loaded map and keep its info and thing counts in stats to be
+// reported later. Returns the number of tiles written.
+static uint32_t DrawAndGetStats( map_t* map, const drawsettings_t* settings,
+                                 const char* outname, mapstats_t* stats ) {
+    phasetimer_t timer;
+    uint32_t tiles = DrawMap( map, settings, outname );
+
+    Dump_GetMapStats( stats, map );
+    if ( settings->countThings ) {
+        Stats_Begin( &timer, PHASE_COUNT );
+        ClearThingCounts( &stats->counts );
+        CountThings( &stats->counts, map );
+        stats->counted = 1;
+        Stats_End( &timer );
+    }
+    return tiles;
+}
+
+// Print a map's info and thing counts
+static void PrintMapStats( const mapstats_t* stats, const drawsettings_t* settings,
+                           const char* outname, uint32_t tiles ) {
+    printf( "Name: %.8s\nDimensions: %ux%u\nThings: %u\nLinedefs: %u\n"
+            "Sidedefs: %u\nVertexes: %u\nSectors: %u\n\n", stats->name, stats->width,
+            stats->height, stats->numthings, stats->numlinedefs, stats->numsidedefs,
+            stats->numvertexes, stats->numsectors );
+    if ( settings->exportTiles ) {
+        printf( "Wrote %u tiles to %s/\n\n", tiles, outname );
+    }
+    if ( stats->counted ) {
+        printf( "Thing counts for %.8s:\n", stats->name );
+        PrintThingCounts( &stats->counts );
+    }
+}
+
+// Load, draw and count a single map of a batch
+static void DrawMapJob( uint32_t job, uint32_t worker, void* data ) {
+    mapbatch_t* batch = (mapbatch_t*)data;
+    statsrecord_t* prevRecord = NULL;
+    map_t map;
+    char outname[9] = "";
+
+    // Count this map's phases in its own record and tag its spans
+    if ( batch->records != NULL ) {
+        memcpy( batch->records[job].name, batch->maps[job].name, 8 );
+        prevRecord = Stats_SetRecord( &batch->records[job] );
+    }
+    Trace_SetMap( batch->maps[job].name );
+    WAD_ReadMap( batch->wadhandle, batch->wad, &batch->maps[job], batch->parts,
+                 &batch->arenas[worker], &map );
+    GetOutName( map.name, outname );
+    batch->tiles[job] = DrawAndGetStats( &map, batch->settings, outname, &batch->stats[job] );
+    if ( batch->records != NULL ) {
+        Stats_SetRecord( prevRecord );
+    }
+    Trace_SetMap( NULL );
+}
+
 int32_t main( void ) {
-    uint16_t     l = 0; // Counter
+    uint32_t     l = 0; // Counter
     char*        wadfilename = NULL; // WAD filename specified
     char*        mapname = NULL; // Map name to find
-    wadfile_t    wad; // Contains WAD info and lump info table
+    waddir_t     dir; // WAD info, lump info table and what's derived from it
+    char         cachefile[1024] = ""; // Directory cache file name
     map_t        map; // The map object
-    color_t      pal[256] = {0}; // Palette
-    uint16_t     nextMapLump = 0; // Number of next map lump to read
+    maparena_t   arena; // Memory for the map
+    drawsettings_t settings; // How to draw the map
+    wad_handle_t* wadhandle = NULL; // The open WAD file
+    color_t      palBuf[256] = {0}; // Palette, if it isn't used from the file
+    const color_t* pal = palBuf; // Palette
+    mapblock_t*  mapBlock = NULL; // The specified map
+    uint8_t      batchMode = 0; // Draw every map?
+    mapbatch_t   batch; // Every map in the WAD, for batch mode
+    uint32_t     numWorkers = 0, w = 0; // Worker threads in batch mode
+    uint32_t     arenaAllocs = 0; // Map allocations made in batch mode
+    thingcounts_t totals; // Thing counts of every map in batch mode
+    dumpformat_t dumpFormat = DUMP_TEXT; // How the WAD info is output
+    dumper_t     dumper; // Machine readable output, unless it's text
+    mapstats_t   stats; // The map's stats
+    uint32_t     tiles = 0; // Tiles written for the map
+    char         outname[9] = ""; // Output name of each map in batch mode
+    outsink_t    out = Sink_File( stdout );
+    FILE*        msg = stdout; // Where progress messages go
+    statsrecord_t wadStats; // Phase stats of everything but the maps
+    statsrecord_t mapStats; // Phase stats of the map, or all maps in batch mode
+    phasetimer_t timer; // Times the phase being worked on
 
-    strcpy( map.name, "" ); // If this never changes, we didn't find the map
     // Load config.ini file
     ini = iniparser_load( "config.ini" );
     if ( ini == NULL ) {
@@ -34,84 +139,231 @@ int32_t main( void ) {
         fprintf( stderr, "Error! Must specify a WAD file!" );
         exit( EXIT_FAILURE );
     }
+    batchMode = (uint8_t)iniparser_getboolean( ini, "Main:batch", 0 );
+    if ( batchMode ) {
+        numWorkers = GetNumWorkers( (uint32_t)iniparser_getint( ini, "Main:threads", 0 ) );
+    }
+
+    // Phase stats are counted from here on if they're wanted. A map drawn
+    // on each worker keeps its CPU time to its own thread.
+    memset( &wadStats, 0, sizeof(wadStats) );
+    memset( &mapStats, 0, sizeof(mapStats) );
+    if ( iniparser_getboolean( ini, "Main:stats", 0 ) ) {
+        Stats_Enable( batchMode && numWorkers > 1 );
+        Stats_SetRecord( &wadStats );
+    }
+    // So is a trace of where each thread spent its time, if one is wanted
+    if ( iniparser_getstring( ini, "Main:trace", "" )[0] != '\0' ) {
+        Trace_Open( iniparser_getstring( ini, "Main:trace", "" ) );
+    }
 
     // Open the WAD file for reading
-    WAD_OpenFile( wadfilename );
+    Stats_Begin( &timer, PHASE_DIRECTORY );
+    wadhandle = WAD_OpenFile( wadfilename,
+                    (uint8_t)iniparser_getboolean( ini, "Main:mmap", 1 ) );
+    if ( wadhandle == NULL ) {
+        exit( EXIT_FAILURE );
+    }
+
+    Stats_End( &timer );
+
+    MapArena_Init( &arena );
+    LoadDrawSettings( &settings );
 
-    // Read WAD header
-    printf( "Loading WAD file: %s...\n", wadfilename );
-    WAD_ReadHeader( &wad.info );
+    // Machine readable output gets stdout to itself
+    dumpFormat = Dump_FormatByName( iniparser_getstring( ini, "Main:output", "text" ) );
+    if ( dumpFormat == DUMP_NUMFORMATS ) {
+        fprintf( stderr, "Unknown output format %s, using text\n",
+                 iniparser_getstring( ini, "Main:output", "" ) );
+        dumpFormat = DUMP_TEXT;
+    }
+    if ( dumpFormat != DUMP_TEXT ) {
+        msg = stderr;
+        if ( !Dump_Begin( &dumper, dumpFormat, &out ) ) {
+            fprintf( stderr, "Error allocating dump writer!\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    // Read WAD header and directory, using the cache file if enabled
+    fprintf( msg, "Loading WAD file: %s...\n", wadfilename );
+    if ( iniparser_getboolean( ini, "Main:dirCache", 0 ) ) {
+        snprintf( cachefile, sizeof(cachefile), "%s.dircache", wadfilename );
+    }
+    Stats_Begin( &timer, PHASE_DIRECTORY );
+    WAD_LoadDir( wadhandle, wadfilename, cachefile[0] ? cachefile : NULL, &dir );
 
     // Get name of map to find from config file
     mapname = iniparser_getstring( ini, "Main:map", NULL );
-    // Allocate memory for lump info array
-    wad.lumps = (lumpinfo_t*)malloc( sizeof(lumpinfo_t) * wad.info.numlumps );
-    // Read all the lump entries in the directory
-    for ( l = 0; l < wad.info.numlumps; ++l ) {
-        WAD_ReadLump( &wad.lumps[l] );
-
-        // Find palette
-        if ( !strcmp( wad.lumps[l].name, "PLAYPAL" ) ) {
-            WAD_ReadPalette( pal, &wad.lumps[l] );
-        }
 
-        // Find specified map
-        if ( mapname != NULL && !strcmp( wad.lumps[l].name, mapname ) ) {
-            strcpy( map.name, wad.lumps[l].name );
-            printf( "    Found %.8s!\n", map.name );
-            nextMapLump = l + 1; // THINGS
+    // Read palette
+    if ( dir.palLump != LUMP_NONE ) {
+        pal = WAD_ReadPalette( wadhandle, palBuf, &dir.wad.lumps[dir.palLump] );
+    }
+
+    if ( batchMode ) {
+        fprintf( msg, "    Found %u maps!\n", dir.numMaps );
+    // Find specified map, the last one with the name wins
+    } else if ( mapname != NULL ) {
+        uint64_t key = WAD_LumpKey( mapname );
+        uint32_t m = dir.numMaps;
+        while ( m-- > 0 ) {
+            if ( WAD_LumpKey( dir.maps[m].name ) == key ) {
+                mapBlock = &dir.maps[m];
+                fprintf( msg, "    Found %.8s!\n", mapBlock->name );
+                break;
+            }
         }
     }
+    Stats_End( &timer );
 
     // Load map
-    if ( strcmp( map.name, "" ) ) {
-        WAD_ReadMapThings( &map, &wad.lumps[nextMapLump++] );
-        WAD_ReadMapLinedefs( &map, &wad.lumps[nextMapLump++] );
-        WAD_ReadMapSidedefs( &map, &wad.lumps[nextMapLump++] );
-        WAD_ReadMapVertexes( &map, &wad.lumps[nextMapLump] ); nextMapLump += 4;
-        WAD_ReadMapSectors( &map, &wad.lumps[nextMapLump] );
+    if ( mapBlock != NULL ) {
+        memcpy( mapStats.name, mapBlock->name, 8 );
+        Stats_SetRecord( &mapStats );
+        Trace_SetMap( mapBlock->name );
+        WAD_ReadMap( wadhandle, &dir.wad, mapBlock, GetDrawMapParts( &settings ), &arena, &map );
+        Trace_SetMap( NULL );
+        Stats_SetRecord( &wadStats );
+    }
+    fprintf( msg, "Done loading WAD file.\n\n" );
+    // Dumps start with the directory
+    if ( dumpFormat != DUMP_TEXT ) {
+        Stats_Begin( &timer, PHASE_OUTPUT );
+        Dump_WadInfo( &dumper, wadfilename, &dir.wad.info );
+        Dump_Lumps( &dumper, dir.wad.lumps, dir.wad.info.numlumps );
+        Stats_End( &timer );
     }
-
-    // Close the WAD file
-    WAD_CloseFile();
-    printf( "Done loading WAD file.\n\n" );
 
     // Draw the map
-    if ( strcmp( map.name, "" ) ) {
-        DrawMap( &map );
+    if ( batchMode ) {
+        // Load and draw every map on the worker threads
+        batch.wadhandle = wadhandle;
+        batch.wad = &dir.wad;
+        batch.maps = dir.maps;
+        batch.parts = GetDrawMapParts( &settings );
+        batch.settings = &settings;
+        // The maps are already drawn in parallel, so draw each one's tiles
+        // on the thread drawing it
+        if ( numWorkers > 1 ) {
+            settings.renderThreads = 1;
+        }
+        batch.arenas = (maparena_t*)calloc( numWorkers, sizeof(maparena_t) );
+        batch.stats = (mapstats_t*)calloc( dir.numMaps + 1, sizeof(mapstats_t) );
+        batch.tiles = (uint32_t*)calloc( dir.numMaps + 1, sizeof(uint32_t) );
+        batch.records = NULL;
+        if ( Stats_Enabled() ) {
+            batch.records = (statsrecord_t*)calloc( dir.numMaps + 1, sizeof(statsrecord_t) );
+        }
+        if ( batch.arenas == NULL || batch.stats == NULL || batch.tiles == NULL ||
+             (Stats_Enabled() && batch.records == NULL) ) {
+            fprintf( stderr, "Error allocating batch!\n" );
+            exit( EXIT_FAILURE );
+        }
+        RunJobs( dir.numMaps, numWorkers, DrawMapJob, &batch );
+        // Each worker's arena is reused for all of its maps
+        for ( w = 0; w < numWorkers; ++w ) {
+            arenaAllocs += batch.arenas[w].numAllocs;
+            MapArena_Free( &batch.arenas[w] );
+        }
+        fprintf( msg, "Loaded %u maps with %u map allocations.\n\n", dir.numMaps, arenaAllocs );
+        free( batch.arenas );
+        // Report the maps in order now they're all done
+        Stats_Begin( &timer, PHASE_OUTPUT );
+        if ( dumpFormat != DUMP_TEXT ) {
+            for ( w = 0; w < dir.numMaps; ++w ) {
+                Dump_Map( &dumper, &batch.stats[w] );
+            }
+        } else {
+            ClearThingCounts( &totals );
+            for ( w = 0; w < dir.numMaps; ++w ) {
+                GetOutName( batch.stats[w].name, outname );
+                PrintMapStats( &batch.stats[w], &settings, outname, batch.tiles[w] );
+                MergeThingCounts( &totals, &batch.stats[w].counts );
+            }
+            // Total up the thing counts of every map
+            if ( settings.countThings ) {
+                printf( "Thing counts for all %u maps:\n", dir.numMaps );
+                PrintThingCounts( &totals );
+            }
+        }
+        Stats_End( &timer );
+        free( batch.stats );
+        free( batch.tiles );
+    } else if ( mapBlock != NULL ) {
+        Stats_SetRecord( &mapStats );
+        Trace_SetMap( mapBlock->name );
+        tiles = DrawAndGetStats( &map, &settings, "map", &stats );
+        Stats_Begin( &timer, PHASE_OUTPUT );
+        if ( dumpFormat != DUMP_TEXT ) {
+            Dump_Map( &dumper, &stats );
+        } else {
+            PrintMapStats( &stats, &settings, "map", tiles );
+        }
+        Stats_End( &timer );
+        Trace_SetMap( NULL );
+        Stats_SetRecord( &wadStats );
     } else {
-        printf( "Map not found!\n\n" );
+        fprintf( msg, "Map not found!\n\n" );
     }
+
     // Palette?
-    DrawPalette( pal );
+    DrawPalette( pal, &settings );
 
-    // Done with config file
-    iniparser_freedict( ini );
     // Output WAD information
-    printf( "Dump of WAD file: %s\n\n", wadfilename );
-    printf( "WAD INFO:\n"
-            "    ID: %.4s\n"
-            "    numlumps: %d\n"
-            "    infotableofs: 0x%08X\n\n",
-            wad.info.id, wad.info.numlumps, wad.info.infotableofs );
-    // Output the lump directory
-    for ( l = 0; l < wad.info.numlumps; ++l) {
-        printf( "LUMP %d:\n"
-                "    name: %.8s\n"
-                "    filepos: 0x%08X\n"
-                "    size: %d bytes\n\n", l + 1,
-                wad.lumps[l].name, wad.lumps[l].filepos, wad.lumps[l].size);
+    Stats_Begin( &timer, PHASE_OUTPUT );
+    if ( dumpFormat != DUMP_TEXT ) {
+        if ( !Dump_End( &dumper ) ) {
+            fprintf( stderr, "Error writing dump!\n" );
+        }
+    } else {
+        printf( "Dump of WAD file: %s\n\n", wadfilename );
+        printf( "WAD INFO:\n"
+                "    ID: %.4s\n"
+                "    numlumps: %u\n"
+                "    infotableofs: 0x%08X\n\n",
+                dir.wad.info.id, dir.wad.info.numlumps, dir.wad.info.infotableofs );
+        // Output the lump directory
+        for ( l = 0; l < dir.wad.info.numlumps; ++l) {
+            printf( "LUMP %u:\n"
+                    "    name: %.8s\n"
+                    "    filepos: 0x%08X\n"
+                    "    size: %u bytes\n\n", l + 1,
+                    dir.wad.lumps[l].name, dir.wad.lumps[l].filepos, dir.wad.lumps[l].size);
+        }
+    }
+    Stats_End( &timer );
+
+    // Every worker has finished, so the trace can be written
+    Trace_Close();
+
+    // Phase stats go to stderr, out of the way of the dump
+    if ( Stats_Enabled() ) {
+        char title[64] = "";
+        fflush( stdout );
+        Stats_Print( stderr, "Stats for the WAD:", &wadStats );
+        if ( batchMode ) {
+            for ( w = 0; w < dir.numMaps; ++w ) {
+                snprintf( title, sizeof(title), "Stats for %.8s:", batch.records[w].name );
+                Stats_Print( stderr, title, &batch.records[w] );
+                Stats_Merge( &mapStats, &batch.records[w] );
+            }
+            snprintf( title, sizeof(title), "Stats for all %u maps:", dir.numMaps );
+            Stats_Print( stderr, title, &mapStats );
+            free( batch.records );
+        } else if ( mapBlock != NULL ) {
+            snprintf( title, sizeof(title), "Stats for %.8s:", mapStats.name );
+            Stats_Print( stderr, title, &mapStats );
+        }
     }
 
     // Cleanup
-    if ( strcmp( map.name, "" ) ) {
-        free( map.sectors );
-        free( map.vertexes );
-        free( map.sidedefs );
-        free( map.linedefs );
-        free( map.things );
-    }
-    free( wad.lumps );
+    MapArena_Free( &arena );
+    WAD_FreeDir( &dir );
+    // The directory and palette can point into the file, so it's closed last
+    WAD_CloseFile( wadhandle );
+    // Done with config file, wadfilename points into it
+    iniparser_freedict( ini );
 
     //system( "PAUSE" );
     exit( EXIT_SUCCESS );
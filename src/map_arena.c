@@ -0,0 +1,72 @@
+/*
+** map_arena.c
+**
+** A single block of memory holding all of a map's arrays, reused from one
+** map to the next
+*/
+
+#include "map_arena.h"
+#include "phase_stats.h"
+
+/*
+** Initialize an empty arena
+*/
+void MapArena_Init( maparena_t* arena ) {
+    memset( arena, 0, sizeof(maparena_t) );
+}
+
+/*
+** Start a new map
+*/
+void MapArena_Reset( maparena_t* arena, size_t size ) {
+    arena->used = 0;
+    ++arena->numResets;
+    if ( size <= arena->capacity ) {
+        return;
+    }
+    // Grow with some headroom so the next slightly bigger map fits too
+    free( arena->base );
+    arena->capacity = size + size / 4;
+    arena->base = (uint8_t*)malloc( arena->capacity );
+    if ( arena->base == NULL ) {
+        fprintf( stderr, "Error allocating %lu bytes for map!\n",
+                 (unsigned long)arena->capacity );
+        exit( EXIT_FAILURE );
+    }
+    ++arena->numAllocs;
+    Stats_AddAlloc();
+}
+
+/*
+** Bytes MapArena_Alloc uses for an array of size bytes
+*/
+size_t MapArena_Size( size_t size ) {
+    return (size + 7) & ~(size_t)7;
+}
+
+/*
+** Hand out size bytes
+*/
+void* MapArena_Alloc( maparena_t* arena, size_t size ) {
+    void* p = NULL;
+    if ( size == 0 ) {
+        return NULL;
+    }
+    size = MapArena_Size( size );
+    if ( size > arena->capacity - arena->used ) {
+        fprintf( stderr, "Error! Map arena is out of room!\n" );
+        exit( EXIT_FAILURE );
+    }
+    p = arena->base + arena->used;
+    arena->used += size;
+    return p;
+}
+
+/*
+** Free the arena's memory
+*/
+void MapArena_Free( maparena_t* arena ) {
+    free( arena->base );
+    arena->base = NULL;
+    arena->used = arena->capacity = 0;
+}
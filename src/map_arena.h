@@ -0,0 +1,49 @@
+/*
+** map_arena.h
+**
+** A single block of memory holding all of a map's arrays, reused from one
+** map to the next
+*/
+
+#ifndef __MAP_ARENA_H
+#define __MAP_ARENA_H
+
+#include "shared.h"
+
+// Map memory arena
+typedef struct {
+    uint8_t* base;      // The block
+    size_t   used;      // Bytes handed out since the last reset
+    size_t   capacity;  // Size of the block
+    uint32_t numAllocs; // Number of times the block had to be allocated
+    uint32_t numResets; // Number of maps laid out in the arena
+} maparena_t;
+
+/*
+** Initialize an empty arena
+*/
+void MapArena_Init( maparena_t* arena );
+
+/*
+** Start a new map, making sure there's room for size bytes of arrays.
+** Everything handed out before is invalid after this.
+*/
+void MapArena_Reset( maparena_t* arena, size_t size );
+
+/*
+** Hand out size bytes, 8 byte aligned. There must be room for it left
+** from the last reset.
+*/
+void* MapArena_Alloc( maparena_t* arena, size_t size );
+
+/*
+** Bytes MapArena_Alloc uses for an array of size bytes
+*/
+size_t MapArena_Size( size_t size );
+
+/*
+** Free the arena's memory
+*/
+void MapArena_Free( maparena_t* arena );
+
+#endif
@@ -5,216 +5,426 @@
 */
 
 #include "map_drawer.h"
-#include <cairo/cairo-svg.h>
-#include "thing_counter.h"
+#include <cairo/cairo.h>
+#include "wad_reader.h"
+#include "map_view.h"
+#include "line_specials.h"
+#include "tile_renderer.h"
+#include "tile_pyramid.h"
+#include "display_lod.h"
+#include "svg_writer.h"
+#include "image_writer.h"
+#include "raster.h"
+#include "phase_stats.h"
+#include "trace.h"
 
 // Convert 255 based color to 1.0 based color
 #define NORM_COLOR(c) c.r / 255.0, c.g / 255.0, c.b / 255.0
 
-// Array of trigger linedef numbers
-static const int16_t trigLineNums[] = {
-    // Doors
-    1, 2, 3, 4, 16, 29, 31, 42, 46, 50, 61, 63, 75, 76, 86, 90, 103, 105, 106,
-    107, 108, 109, 110, 111, 112, 113, 114, 115, 116, 117, 118, 175, 196,
-    // Floors
-    5, 18, 19, 23, 24, 30, 36, 37, 38, 45, 55, 56, 58, 59, 60, 64, 65, 69, 70,
-    71, 78, 82, 83, 84, 91, 92, 93, 94, 96, 98, 101, 102, 119, 128, 129, 130,
-    131, 132, 140, 142, 147, 153, 154, 158, 159, 160, 161, 176, 177, 178, 179,
-    180, 189, 190, 219, 220, 221, 222, 239, 240, 241,
-    // Ceilings
-    40, 41, 43, 44, 72, 145, 151, 152, 166, 167, 186, 187, 199, 200, 201, 202,
-    203, 204, 205, 206,
-    // Platforms
-    10, 14, 15, 20, 21, 22, 47, 53, 54, 62, 66, 67, 68, 87, 88, 89, 95, 120, 121,
-    122, 123, 143, 144, 148, 149, 162, 163, 181, 182, 211, 212,
-    // Crushers
-    6, 25, 49, 57, 73, 74, 77, 141, 150, 164, 165, 168, 183, 184, 185, 188,
-    // Stair builders
-    7, 8, 100, 127, 256, 257, 258, 259,
-    // Elevators
-    227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238,
-    // Lighting
-    12, 13, 17, 35, 79, 80, 81, 104, 138, 139, 156, 157, 169, 170, 171, 172,
-    173, 192, 193, 194,
-    // Exits
-    11, 51, 52, 124, 197, 198,
-    // Teleporters
-    39, 97, 125, 126, 174, 195, 207, 208, 209, 210, 243, 244, 262, 263, 264, 265,
-    266, 267, 268, 269,
-    // Donuts
-    9, 146, 155, 191
-};
-
-void DrawPalette( color_t* pal ) {
-    cairo_surface_t* surface = NULL;
-    cairo_t* cr = NULL;
+uint8_t DrawPaletteTo( const color_t* pal, const drawsettings_t* settings,
+                       const outsink_t* sink ) {
+    framebuffer_t fb;
+    phasetimer_t render, encode;
+    tracespan_t span;
     uint16_t i = 0;
+    uint8_t ok = 0;
 
-    surface = cairo_image_surface_create( CAIRO_FORMAT_RGB24, 16, 16 );
-    cr = cairo_create( surface );
-    cairo_set_antialias( cr, CAIRO_ANTIALIAS_NONE );
-
+    Stats_Begin( &render, PHASE_RENDER );
+    FB_Init( &fb, 16, 16, pal[0] );
     for ( i = 0; i < 256; ++i ) {
-        cairo_set_source_rgb( cr, NORM_COLOR(pal[i]) );
-        cairo_rectangle( cr, i % 16, i / 16, 1.0, 1.0 );
-        cairo_fill( cr );
+        FB_FillRect( &fb, i % 16, i / 16, 1.0f, 1.0f, pal[i] );
     }
 
     // Write and cleanup
-    cairo_surface_write_to_png( surface, "pal.png" );
-    cairo_destroy( cr );
-    cairo_surface_destroy( surface );
+    Stats_Begin( &encode, PHASE_ENCODE );
+    Trace_Begin( &span, "IMG_WriteSink" );
+    ok = IMG_WriteSink( sink, (imageformat_t)settings->imageFormat, fb.pixels, 16, 16 );
+    Trace_End( &span );
+    Stats_End( &encode );
+    FB_Free( &fb );
+    Stats_End( &render );
+    return ok;
+}
+
+void DrawPalette( const color_t* pal, const drawsettings_t* settings ) {
+    char filename[32] = "";
+    FILE* f = NULL;
+    outsink_t sink;
+    uint8_t ok = 0;
+
+    snprintf( filename, sizeof(filename), "pal.%s",
+              IMG_Extension( (imageformat_t)settings->imageFormat ) );
+    f = fopen( filename, "wb" );
+    if ( f != NULL ) {
+        sink = Sink_File( f );
+        ok = DrawPaletteTo( pal, settings, &sink );
+        ok = (fclose( f ) == 0) && ok;
+    }
+    if ( !ok ) {
+        fprintf( stderr, "Error writing %s!\n", filename );
+    }
+}
+
+void LoadDrawSettings( drawsettings_t* settings ) {
+    const char* sizes = NULL;
+    const char* format = NULL;
+    char* end = NULL;
+
+    settings->maxSize = (uint32_t)iniparser_getint( ini, "MapDrawer:maxSize", 1024 );
+    // Any number of sizes can be drawn, maxSize is used if none are given
+    sizes = iniparser_getstring( ini, "MapDrawer:sizes", "" );
+    settings->numSizes = 0;
+    while ( settings->numSizes < DRAW_MAX_SIZES ) {
+        uint32_t size = (uint32_t)strtoul( sizes, &end, 10 );
+        if ( end == sizes ) {
+            break;
+        }
+        if ( size > 0 ) {
+            settings->sizes[settings->numSizes++] = size;
+        }
+        sizes = end;
+    }
+    if ( settings->numSizes == 0 ) {
+        settings->sizes[settings->numSizes++] = settings->maxSize;
+    }
+    settings->antiAlias = (uint8_t)iniparser_getboolean( ini, "MapDrawer:antiAlias", 1 );
+    settings->lineWidth = iniparser_getdouble( ini, "MapDrawer:lineWidth", 2.0 );
+    settings->drawThings = (uint8_t)iniparser_getboolean( ini, "MapDrawer:drawThings", 0 );
+    settings->countThings = (uint8_t)iniparser_getboolean( ini, "MapDrawer:countThings", 0 );
+    settings->batchPaths = (uint8_t)iniparser_getboolean( ini, "MapDrawer:batchPaths", 0 );
+    settings->lod = (uint8_t)iniparser_getboolean( ini, "MapDrawer:lod", 0 );
+    settings->svgDecimals = (uint8_t)iniparser_getint( ini, "MapDrawer:svgDecimals", 1 );
+    settings->renderer = RENDERER_CAIRO;
+    if ( strcmp( iniparser_getstring( ini, "MapDrawer:renderer", "cairo" ), "native" ) == 0 ) {
+        settings->renderer = RENDERER_NATIVE;
+    }
+    settings->tileHeight = (uint32_t)iniparser_getint( ini, "MapDrawer:tileHeight", 256 );
+    settings->renderThreads = (uint32_t)iniparser_getint( ini, "MapDrawer:threads", 0 );
+    settings->exportTiles = (uint8_t)iniparser_getboolean( ini, "MapDrawer:tiles", 0 );
+    settings->maxZoom = (uint8_t)iniparser_getint( ini, "MapDrawer:maxZoom", 4 );
+    format = iniparser_getstring( ini, "MapDrawer:format", "png" );
+    settings->imageFormat = (uint8_t)IMG_FormatByName( format );
+    if ( settings->imageFormat == IMG_NUMFORMATS ) {
+        fprintf( stderr, "Unknown image format %s, using png\n", format );
+        settings->imageFormat = IMG_PNG;
+    }
+}
+
+// Color of each line style
+static const color_t styleColors[LS_NUMSTYLES] = {
+    {0, 0, 0},       // Normal wall
+    {128, 128, 128}, // Same height
+    {128, 128, 128}, // Ceiling difference
+    {128, 128, 128}, // Floor difference
+    {224, 112, 0},   // Trigger
+    {0, 0, 255},     // Blue door
+    {255, 0, 0},     // Red door
+    {255, 230, 0}    // Yellow door
+};
+
+color_t GetLineStyleColor( linestyle_t style ) {
+    return styleColors[style];
+}
+
+uint8_t GetThingMarker( int16_t type, color_t* color, double* radius ) {
+    static const color_t green = {0, 255, 0}, blue = {0, 0, 255},
+                         red = {255, 0, 0}, yellow = {255, 230, 0};
+
+    *radius = 20.0; // Keys
+    if ( type == 1 ) { // Player 1 start
+        *color = green;
+        *radius = 16.0;
+    } else if ( type == 5 || type == 40 ) { // Blue card / skull
+        *color = blue;
+    } else if ( type == 13 || type == 38 ) { // Red card / skull
+        *color = red;
+    } else if ( type == 6 || type == 39 ) { // Yellow card / skull
+        *color = yellow;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Check a sidedef number is valid and so is the sector it faces
+static uint8_t SideSector( const map_t* map, int16_t side ) {
+    return side >= 0 && (uint32_t)side < map->numsidedefs &&
+           map->sidedefs[side].sectornum < map->numsectors;
+}
+
+linestyle_t GetLineStyle( const map_t* map, const linedef_t* linedef ) {
+    linestyle_t style = LS_WALL; // Default is regular solid wall
+    specialclass_t sc;
+
+    // Check for two sided
+    if ( linedef->sidenum[1] >= 0 && SideSector( map, linedef->sidenum[0] ) &&
+         SideSector( map, linedef->sidenum[1] ) ) {
+        const sector_t* frontsector = &map->sectors[map->sidedefs[linedef->sidenum[0]].sectornum];
+        const sector_t* backsector = &map->sectors[map->sidedefs[linedef->sidenum[1]].sectornum];
+        if ( frontsector->floorheight != backsector->floorheight ) { // Floor difference
+            style = LS_FLOORDIFF;
+        } else if ( frontsector->ceilingheight != backsector->ceilingheight ) { // Ceiling difference
+            style = LS_CEILDIFF;
+        } else { // Same height
+            style = LS_SAMEHEIGHT;
+        }
+    }
+
+    // Check for triggers and locked doors
+    sc = ClassifySpecial( (uint16_t)linedef->special );
+    if ( sc.key == KEY_BLUE ) {
+        style = LS_BLUEKEY;
+    } else if ( sc.key == KEY_RED ) {
+        style = LS_REDKEY;
+    } else if ( sc.key == KEY_YELLOW ) {
+        style = LS_YELLOWKEY;
+    } else if ( sc.category != SC_NONE && sc.category != SC_EFFECT ) {
+        style = LS_TRIGGER;
+    }
+    return style;
+}
+
+// Draw the lines one style at a time, with a single path and stroke for
+// each style instead of one per line
+static void DrawLinesByStyle( cairo_t* cr, const displaylist_t* dl, const mapview_t* view ) {
+    uint32_t i = 0, s = 0;
+
+    for ( s = 0; s < LS_NUMSTYLES; ++s ) {
+        if ( dl->styleStarts[s] == dl->styleStarts[s + 1] ) {
+            continue;
+        }
+        cairo_set_source_rgb( cr, NORM_COLOR(styleColors[s]) );
+        for ( i = dl->styleStarts[s]; i < dl->styleStarts[s + 1]; ++i ) {
+            const dlline_t* line = &dl->lines[dl->byStyle[i]];
+            cairo_move_to( cr, view->verts[line->v1 * 2], view->verts[line->v1 * 2 + 1] );
+            cairo_line_to( cr, view->verts[line->v2 * 2], view->verts[line->v2 * 2 + 1] );
+        }
+        cairo_stroke( cr );
+    }
 }
 
-void DrawMap( map_t* map ) {
+uint32_t GetDrawMapParts( const drawsettings_t* settings ) {
+    uint32_t parts = MAP_READ_LINES;
+    // Things are only needed if they're drawn or counted
+    if ( settings->drawThings || settings->countThings ) {
+        parts |= MAP_READ_THINGS;
+    }
+    return parts;
+}
+
+// Pass cairo's PNG output on to a sink
+static cairo_status_t WriteCairoData( void* closure, const unsigned char* data,
+                                      unsigned int length ) {
+    const outsink_t* sink = (const outsink_t*)closure;
+    return sink->write( sink->ctx, data, length ) ? CAIRO_STATUS_SUCCESS
+                                                  : CAIRO_STATUS_WRITE_ERROR;
+}
+
+// Write a cairo RGB24 surface to a sink in any image format
+static uint8_t WriteCairoImage( cairo_surface_t* surface, imageformat_t format,
+                                const outsink_t* sink ) {
+    uint32_t width = (uint32_t)cairo_image_surface_get_width( surface );
+    uint32_t height = (uint32_t)cairo_image_surface_get_height( surface );
+    const uint8_t* data = NULL;
+    imagestream_t* is = NULL;
+    uint8_t* row = NULL;
+    uint32_t x = 0, y = 0;
+    uint8_t ok = 1;
+
+    if ( format == IMG_PNG ) {
+        return cairo_surface_write_to_png_stream( surface, WriteCairoData,
+                                                  (void*)sink ) == CAIRO_STATUS_SUCCESS;
+    }
+    // cairo keeps pixels as native endian 0xXXRRGGBB words
+    cairo_surface_flush( surface );
+    data = cairo_image_surface_get_data( surface );
+    row = (uint8_t*)malloc( (size_t)width * 4 + 1 );
+    is = (row != NULL) ? IMG_BeginSink( sink, format, width, height ) : NULL;
+    if ( is == NULL ) {
+        free( row );
+        return 0;
+    }
+    Stats_AddAlloc();
+    for ( y = 0; ok && y < height; ++y ) {
+        const uint32_t* src = (const uint32_t*)(data + (size_t)y *
+                                                cairo_image_surface_get_stride( surface ));
+        for ( x = 0; x < width; ++x ) {
+            row[x * 4] = (uint8_t)(src[x] >> 16);
+            row[x * 4 + 1] = (uint8_t)(src[x] >> 8);
+            row[x * 4 + 2] = (uint8_t)src[x];
+            row[x * 4 + 3] = 255;
+        }
+        ok = IMG_WriteRows( is, row, 1 );
+    }
+    free( row );
+    return IMG_End( is ) && ok;
+}
+
+// Draw a display list with cairo and write it to a sink
+static uint8_t DrawCairoImage( const displaylist_t* dl, const drawsettings_t* settings,
+                               const mapview_t* view, color_t bgColor,
+                               const outsink_t* sink ) {
     cairo_surface_t* surface = NULL;
     cairo_t* cr = NULL;
-    uint16_t surfaceW = (uint16_t)iniparser_getint( ini, "MapDrawer:maxSize", 1024 ),
-             surfaceH = surfaceW;
-    double scale = 1.0;
+    phasetimer_t encode;
+    tracespan_t span;
+    double scale = view->scale;
     uint32_t i = 0;
-    color_t bgColor = {255, 255, 255};
-    color_t wallColor = {0, 0, 0}; // Normal wall color
-    color_t fdColor = {128, 128, 128}; // Floor difference
-    color_t cdColor = {128, 128, 128}; // Ceiling difference
-    color_t shColor = {128, 128, 128}; // Same height
-    color_t trigColor = {224, 112, 0};
-    // Boolean variables
-    uint8_t drawThings = (uint8_t)iniparser_getboolean( ini, "MapDrawer:drawThings", 0 ),
-            countThings = (uint8_t)iniparser_getboolean( ini, "MapDrawer:countThings", 0 );
-
-    // Print info
-    printf( "Name: %.8s\nDimensions: %ux%u\nThings: %d\nLinedefs: %d\n"
-            "Sidedefs: %d\nVertexes: %d\nSectors: %d\n\n", map->name, map->width,
-            map->height, map->numthings, map->numlinedefs, map->numsidedefs,
-            map->numvertexes, map->numsectors );
-
-    if ( map->width > map->height ) {
-        surfaceH = (surfaceW * map->height) / map->width;
-        scale = (double)(surfaceW - 8) / map->width;
-    } else if ( map->height > map->width ) {
-        surfaceW = (surfaceH * map->width) / map->height;
-        scale = (double)(surfaceH - 8) / map->height;
-    } else {
-        scale = (double)(surfaceW - 8) / map->width;
-    }
-    surface = cairo_svg_surface_create( "map.svg", surfaceW, surfaceH );
+    uint8_t ok = 0;
+
+    surface = cairo_image_surface_create( CAIRO_FORMAT_RGB24, view->width, view->height );
     cr = cairo_create( surface );
     cairo_set_source_rgb( cr, NORM_COLOR(bgColor) );
     cairo_paint( cr );
-    if ( !iniparser_getboolean( ini, "MapDrawer:antiAlias", 1 ) ) {
+    if ( !settings->antiAlias ) {
         cairo_set_antialias( cr, CAIRO_ANTIALIAS_NONE );
     }
-    cairo_set_line_width( cr, iniparser_getdouble( ini, "MapDrawer:lineWidth", 2.0 ) );
+    cairo_set_line_width( cr, settings->lineWidth );
 
-    cairo_translate( cr, surfaceW / 2.0, surfaceH / 2.0 );
     // Draw the map's lines
-    for ( i = 0; i < map->numlinedefs; ++i ) {
-        vertex_t v1 = map->vertexes[map->linedefs[i].v1];
-        vertex_t v2 = map->vertexes[map->linedefs[i].v2];
-        linedef_t linedef = map->linedefs[i];
-        uint16_t j = 0;
-
-        // Offset to 0, 0
-        v1.x += -map->centerv.x; v1.y += -map->centerv.y;
-        v2.x += -map->centerv.x; v2.y += -map->centerv.y;
-
-        // Default is regular solid wall
-        cairo_set_source_rgb( cr, NORM_COLOR(wallColor) );
-
-        // Check for two sided
-        if ( linedef.sidenum[1] >= 0 ) {
-            sector_t frontsector = map->sectors[map->sidedefs[linedef.sidenum[0]].sectornum];
-            sector_t backsector = map->sectors[map->sidedefs[linedef.sidenum[1]].sectornum];
-            if ( frontsector.floorheight != backsector.floorheight ) { // Floor difference
-                cairo_set_source_rgb( cr, NORM_COLOR(fdColor) );
-            } else if ( frontsector.ceilingheight != backsector.ceilingheight ) { // Ceiling difference
-                cairo_set_source_rgb( cr, NORM_COLOR(cdColor) );
-            } else { // Same height
-                cairo_set_source_rgb( cr, NORM_COLOR(shColor) );
-            }
+    Trace_Begin( &span, "DrawCairoImage linedefs" );
+    if ( settings->batchPaths ) {
+        DrawLinesByStyle( cr, dl, view );
+    } else {
+        for ( i = 0; i < dl->numlines; ++i ) {
+            const dlline_t* line = &dl->lines[i];
+            cairo_set_source_rgb( cr, NORM_COLOR(styleColors[line->style]) );
+            cairo_move_to( cr, view->verts[line->v1 * 2], view->verts[line->v1 * 2 + 1] );
+            cairo_line_to( cr, view->verts[line->v2 * 2], view->verts[line->v2 * 2 + 1] );
+            cairo_stroke( cr );
         }
+    }
+    Trace_End( &span );
+    // Draw the map's thing markers
+    Trace_Begin( &span, "DrawCairoImage things" );
+    for ( i = 0; i < dl->nummarkers; ++i ) {
+        const dlmarker_t* marker = &dl->markers[i];
+        double x = view->markers[i * 2];
+        double y = view->markers[i * 2 + 1];
+        cairo_set_source_rgb( cr, NORM_COLOR(marker->color) );
+        cairo_rectangle( cr, x - (marker->radius * scale), y - (marker->radius * scale),
+                         marker->radius * 2 * scale, marker->radius * 2 * scale );
+        cairo_fill( cr );
+    }
+    Trace_End( &span );
 
-        // Check for triggers
-        for ( j = 0; j < sizeof(trigLineNums) / sizeof(int16_t); ++j ) {
-            if ( linedef.special == trigLineNums[j] ) {
-                cairo_set_source_rgb( cr, NORM_COLOR(trigColor) );
-                break;
-            }
-        }
+    // Write and cleanup
+    Stats_Begin( &encode, PHASE_ENCODE );
+    Trace_Begin( &span, "WriteCairoImage" );
+    ok = WriteCairoImage( surface, (imageformat_t)settings->imageFormat, sink );
+    Trace_End( &span );
+    Stats_End( &encode );
+    cairo_destroy( cr );
+    cairo_surface_destroy( surface );
+    return ok;
+}
 
-        // Check for locked doors
-        switch ( linedef.special ) {
-            // Red door
-            case 28: case 33: case 134: case 135:
-                cairo_set_source_rgb( cr, 1.0, 0.0, 0.0 );
-                break;
-            // Blue door
-            case 26: case 32: case 99: case 133:
-                cairo_set_source_rgb( cr, 0.0, 0.0, 1.0 );
-                break;
-            // Yellow door
-            case 27: case 34: case 136: case 137:
-                cairo_set_source_rgb( cr, 1.0, 0.9, 0.0 );
-                break;
-            default:
-                break;
-        }
+uint8_t DrawDisplayListTo( const displaylist_t* dl, const drawsettings_t* settings,
+                           uint32_t size, const outsink_t* svg, const outsink_t* image ) {
+    mapview_t view;
+    displaylist_t lod;
+    phasetimer_t render, encode;
+    tracespan_t span;
+    color_t bgColor = {255, 255, 255};
+    uint8_t failed = 0;
 
-        cairo_move_to( cr, v1.x * scale, -(v1.y * scale) );
-        cairo_line_to( cr, v2.x * scale, -(v2.y * scale) );
-        cairo_stroke( cr );
+    Stats_Begin( &render, PHASE_RENDER );
+    // Put every vertex and marker into image space once up front
+    MapView_Setup( &view, dl, size );
+    if ( settings->lod ) {
+        DL_Simplify( &lod, dl, view.scale );
+        dl = &lod;
+    }
+    MapView_Transform( &view, dl );
+
+    if ( svg != NULL ) {
+        Stats_Begin( &encode, PHASE_ENCODE );
+        Trace_Begin( &span, "WriteMapSVG" );
+        if ( !WriteMapSVG( dl, settings, &view, bgColor, svg ) ) {
+            failed |= DRAW_FAILED_SVG;
+        }
+        Trace_End( &span );
+        Stats_End( &encode );
     }
-    // Draw and count the map's things
-    if ( countThings || drawThings ) {
-        for ( i = 0; i < map->numthings; ++i ) {
-            int16_t type = map->things[i].type;
-            // Count thing
-            if ( countThings ) {
-                CountThing( type, map->things[i].flags );
-            }
-            // Draw thing
-            if ( drawThings ) {
-                int16_t x = map->things[i].x += -map->centerv.x;
-                int16_t y = map->things[i].y += -map->centerv.y;
-                // Player 1 start (16 radius)
-                if ( type == 1 ) {
-                    cairo_set_source_rgb( cr, 0.0, 1.0, 0.0 );
-                    cairo_rectangle( cr, (x * scale) - (16 * scale),
-                                     -((y * scale) + (16 * scale)),
-                                     32 * scale, 32 * scale );
-                    cairo_fill( cr );
-                // Keys (20 radius)
-                } else if ( type == 5 || type == 40 ) { // Blue card / skull
-                    cairo_set_source_rgb( cr, 0.0, 0.0, 1.0 );
-                    cairo_rectangle( cr, (x * scale) - (20 * scale),
-                                     -((y * scale) + (20 * scale)),
-                                     40 * scale, 40 * scale );
-                    cairo_fill( cr );
-                } else if ( type == 13 || type == 38 ) { // Red card / skull
-                    cairo_set_source_rgb( cr, 1.0, 0.0, 0.0 );
-                    cairo_rectangle( cr, (x * scale) - (20 * scale),
-                                     -((y * scale) + (20 * scale)),
-                                     40 * scale, 40 * scale );
-                    cairo_fill( cr );
-                } else if ( type == 6 || type == 39 ) { // Yellow card / skull
-                    cairo_set_source_rgb( cr, 1.0, 0.9, 0.0 );
-                    cairo_rectangle( cr, (x * scale) - (20 * scale),
-                                     -((y * scale) + (20 * scale)),
-                                     40 * scale, 40 * scale );
-                    cairo_fill( cr );
-                }
-            }
+    if ( image != NULL ) {
+        uint8_t ok = 0;
+        if ( settings->renderer == RENDERER_NATIVE ) {
+            ok = DrawMapTiles( dl, settings, &view, bgColor, image );
+        } else {
+            ok = DrawCairoImage( dl, settings, &view, bgColor, image );
+        }
+        if ( !ok ) {
+            failed |= DRAW_FAILED_IMAGE;
         }
     }
 
-    // Print thing counts
-    if ( countThings ) {
-        PrintThingCounts();
+    // Cleanup
+    MapView_Free( &view );
+    if ( settings->lod ) {
+        DL_Free( &lod );
     }
+    Stats_End( &render );
+    return failed;
+}
 
-    // Write and cleanup
-    cairo_surface_write_to_png( surface, "map.png" );
-    cairo_destroy( cr );
-    cairo_surface_destroy( surface );
+void DrawDisplayList( const displaylist_t* dl, const drawsettings_t* settings,
+                      uint32_t size, const char* outname ) {
+    char svgname[256] = "", imagename[256] = "";
+    FILE* svgfile = NULL;
+    FILE* imagefile = NULL;
+    outsink_t svg, image;
+    uint8_t failed = 0;
+
+    snprintf( svgname, sizeof(svgname), "%s.svg", outname );
+    snprintf( imagename, sizeof(imagename), "%s.%s", outname,
+              IMG_Extension( (imageformat_t)settings->imageFormat ) );
+    svgfile = fopen( svgname, "wb" );
+    imagefile = fopen( imagename, "wb" );
+    if ( svgfile != NULL ) {
+        svg = Sink_File( svgfile );
+    }
+    if ( imagefile != NULL ) {
+        image = Sink_File( imagefile );
+    }
+    failed = DrawDisplayListTo( dl, settings, size, (svgfile != NULL) ? &svg : NULL,
+                                (imagefile != NULL) ? &image : NULL );
+
+    if ( svgfile == NULL || fclose( svgfile ) != 0 || (failed & DRAW_FAILED_SVG) ) {
+        fprintf( stderr, "Error writing %s!\n", svgname );
+    }
+    if ( imagefile == NULL || fclose( imagefile ) != 0 || (failed & DRAW_FAILED_IMAGE) ) {
+        fprintf( stderr, "Error writing %s!\n", imagename );
+    }
+}
+
+uint32_t DrawMap( map_t* map, const drawsettings_t* settings, const char* outname ) {
+    displaylist_t dl;
+    phasetimer_t timer;
+    tracespan_t span;
+    char sizename[256] = "";
+    uint32_t i = 0, tiles = 0;
+
+    Trace_Begin( &span, "DrawMap" );
+    // The map is only walked once, every output is drawn from the display list
+    Stats_Begin( &timer, PHASE_CLASSIFY );
+    DL_Build( &dl, map, settings->drawThings );
+    Stats_End( &timer );
+    if ( settings->exportTiles ) {
+        // Export a tile pyramid instead of single images. The tiles are
+        // written as they're drawn, so it all counts as rendering.
+        Stats_Begin( &timer, PHASE_RENDER );
+        tiles = ExportMapTiles( &dl, settings, outname );
+        Stats_End( &timer );
+    } else if ( settings->numSizes == 1 ) {
+        DrawDisplayList( &dl, settings, settings->sizes[0], outname );
+    } else {
+        // Name each size's files after the size
+        for ( i = 0; i < settings->numSizes; ++i ) {
+            snprintf( sizename, sizeof(sizename), "%s_%u", outname, settings->sizes[i] );
+            DrawDisplayList( &dl, settings, settings->sizes[i], sizename );
+        }
+    }
+    DL_Free( &dl );
+    Trace_End( &span );
+    return tiles;
 }
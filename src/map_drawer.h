@@ -8,9 +8,101 @@
 #define __MAP_DRAWER_H
 
 #include "shared.h"
+#include "display_list.h"
+#include "out_sink.h"
 
-void DrawPalette( color_t* pal );
-void DrawMap( map_t* map );
+#define DRAW_MAX_SIZES 8 // Most image sizes drawn for each map
+
+// Map drawer settings from the config file
+typedef struct {
+    uint32_t maxSize;     // Maximum image dimension
+    uint32_t sizes[DRAW_MAX_SIZES]; // Maximum dimension of each image drawn
+    uint8_t  numSizes;
+    uint8_t  antiAlias;   // Anti-alias lines?
+    double   lineWidth;   // Line width
+    uint8_t  drawThings;  // Draw player 1 start and keys?
+    uint8_t  countThings; // Count and print the map's things?
+    uint8_t  batchPaths;  // Draw one path per line style instead of per line?
+    uint8_t  lod;         // Simplify lines too small to see at the image size?
+    uint8_t  svgDecimals; // Decimal places of SVG coordinates
+    uint8_t  renderer;    // What draws the image, see RENDERER_*
+    uint32_t tileHeight;  // Height of the tiles the native renderer draws
+    uint32_t renderThreads; // Threads drawing tiles, 0 for one per CPU
+    uint8_t  exportTiles; // Export a z/x/y tile pyramid instead of images?
+    uint8_t  maxZoom;     // Deepest zoom level of the tile pyramid
+    uint8_t  imageFormat; // Format of the images and tiles, see imageformat_t
+} drawsettings_t;
+
+// Image renderers
+#define RENDERER_CAIRO  0 // Drawn on a cairo surface
+#define RENDERER_NATIVE 1 // Drawn by the built in rasterizer
+
+/*
+** Draw the palette's 256 colors as a 16x16 image to pal.<ext>
+*/
+void DrawPalette( const color_t* pal, const drawsettings_t* settings );
+
+/*
+** Draw the palette's 256 colors as a 16x16 image to a sink. Returns 0 if
+** it couldn't be written.
+*/
+uint8_t DrawPaletteTo( const color_t* pal, const drawsettings_t* settings,
+                       const outsink_t* sink );
+
+/*
+** Load the map drawer settings from the config file. The config can't be
+** read from worker threads so this is done once up front.
+*/
+void LoadDrawSettings( drawsettings_t* settings );
+/*
+** Get the style a line is drawn with
+*/
+linestyle_t GetLineStyle( const map_t* map, const linedef_t* linedef );
+
+/*
+** Get the color lines of a style are drawn with
+*/
+color_t GetLineStyleColor( linestyle_t style );
+
+/*
+** Get the color and radius in map units of the marker drawn for a thing
+** type. Returns 0 if the thing doesn't get one.
+*/
+uint8_t GetThingMarker( int16_t type, color_t* color, double* radius );
+
+/*
+** Get the parts of a map DrawMap needs with the current settings,
+** see MAP_READ_* in wad_reader.h
+*/
+uint32_t GetDrawMapParts( const drawsettings_t* settings );
+
+/*
+** Draw a display list to outname.svg and outname.<ext>, with the longest
+** side of the image size pixels. <ext> depends on the image format.
+*/
+void DrawDisplayList( const displaylist_t* dl, const drawsettings_t* settings,
+                      uint32_t size, const char* outname );
+
+// Outputs DrawDisplayListTo couldn't write
+#define DRAW_FAILED_SVG   1
+#define DRAW_FAILED_IMAGE 2
+
+/*
+** Draw a display list to an SVG document and an image written to sinks,
+** e.g. memory buffers, instead of files. Either sink can be NULL to leave
+** that output out. Returns the DRAW_FAILED_* flags of the outputs that
+** couldn't be written, 0 if they all were.
+*/
+uint8_t DrawDisplayListTo( const displaylist_t* dl, const drawsettings_t* settings,
+                           uint32_t size, const outsink_t* svg, const outsink_t* image );
+
+/*
+** Draw a map to outname.svg and outname.<ext>, or outname_<size>.svg and
+** outname_<size>.<ext> for each size when there's more than one. Exporting
+** tiles draws a tile pyramid in the outname directory instead, and the
+** number of tiles written is returned.
+*/
+uint32_t DrawMap( map_t* map, const drawsettings_t* settings, const char* outname );
 
 // Global configuration file
 extern dictionary* ini;
@@ -0,0 +1,91 @@
+/*
+** map_view.c
+**
+** Transforming a map from map units into image space
+*/
+
+#include "map_view.h"
+#include "phase_stats.h"
+
+/*
+** Work out the image size and scale for a map
+*/
+void MapView_Setup( mapview_t* view, const displaylist_t* dl, uint32_t maxSize ) {
+    // A 4 pixel border on each side. Worked out as a double so sizes under
+    // 8 don't wrap round.
+    double inner = (double)maxSize - 8.0;
+    double scale = 1.0;
+
+    view->width = view->height = maxSize;
+    if ( dl->width > dl->height ) {
+        view->height = (uint32_t)(((uint64_t)maxSize * dl->height) / dl->width);
+        scale = inner / dl->width;
+    } else if ( dl->height > dl->width ) {
+        view->width = (uint32_t)(((uint64_t)maxSize * dl->width) / dl->height);
+        scale = inner / dl->height;
+    } else if ( dl->width > 0 ) {
+        scale = inner / dl->width;
+    }
+    view->scale = (float)scale;
+    // The map's center point goes in the middle of the image
+    view->offsetX = (float)(view->width / 2.0 - dl->centerv.x * scale);
+    view->offsetY = (float)(view->height / 2.0 + dl->centerv.y * scale);
+    view->verts = view->markers = NULL;
+}
+
+/*
+** Set up a square view with the map centered in it
+*/
+void MapView_SetupSquare( mapview_t* view, const displaylist_t* dl, uint32_t size ) {
+    uint32_t longest = (dl->width > dl->height) ? dl->width : dl->height;
+    // Leave 1/32 of the size as a border
+    double scale = (longest > 0) ? (size * (31.0 / 32.0)) / longest : 1.0;
+
+    view->width = view->height = size;
+    view->scale = (float)scale;
+    view->offsetX = (float)(size / 2.0 - dl->centerv.x * scale);
+    view->offsetY = (float)(size / 2.0 + dl->centerv.y * scale);
+    view->verts = view->markers = NULL;
+}
+
+// Transform a run of x, y pairs. Both axes are done the same way so the
+// loop is easy for the compiler to vectorize.
+static void TransformPoints( float* restrict out, const int16_t* restrict in,
+                             uint32_t count, float scale, float offsetX,
+                             float offsetY, uint32_t stride ) {
+    uint32_t n = 0;
+    for ( n = 0; n < count; ++n ) {
+        out[n * 2] = in[n * stride] * scale + offsetX;
+        out[n * 2 + 1] = in[n * stride + 1] * -scale + offsetY;
+    }
+}
+
+/*
+** Transform all of a display list's vertexes and markers into image space
+*/
+void MapView_Transform( mapview_t* view, const displaylist_t* dl ) {
+    // Vertexes and markers share one buffer
+    view->verts = (float*)malloc( sizeof(float) * 2 *
+                                  (dl->numverts + dl->nummarkers + 1) );
+    if ( view->verts == NULL ) {
+        fprintf( stderr, "Error allocating map view!\n" );
+        exit( EXIT_FAILURE );
+    }
+    Stats_AddAlloc();
+    view->markers = view->verts + dl->numverts * 2;
+
+    TransformPoints( view->verts, (const int16_t*)dl->verts, dl->numverts,
+                     view->scale, view->offsetX, view->offsetY,
+                     sizeof(vertex_t) / sizeof(int16_t) );
+    TransformPoints( view->markers, (const int16_t*)dl->markers, dl->nummarkers,
+                     view->scale, view->offsetX, view->offsetY,
+                     sizeof(dlmarker_t) / sizeof(int16_t) );
+}
+
+/*
+** Free the transformed positions
+*/
+void MapView_Free( mapview_t* view ) {
+    free( view->verts );
+    view->verts = view->markers = NULL;
+}
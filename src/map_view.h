@@ -0,0 +1,48 @@
+/*
+** map_view.h
+**
+** Transforming a map from map units into image space
+*/
+
+#ifndef __MAP_VIEW_H
+#define __MAP_VIEW_H
+
+#include "shared.h"
+#include "display_list.h"
+
+// A display list as seen in an image. Image space has the origin at the top left
+// and y going down, map space has y going up.
+typedef struct {
+    uint32_t width, height; // Image size
+    float    scale;         // Image pixels per map unit
+    float    offsetX;       // Image position of map x = 0
+    float    offsetY;       // Image position of map y = 0
+    float*   verts;         // x, y of every vertex in image space
+    float*   markers;       // x, y of every thing marker in image space
+} mapview_t;
+
+/*
+** Work out the image size and scale for a map so its longest side fits
+** in maxSize pixels, with a small border
+*/
+void MapView_Setup( mapview_t* view, const displaylist_t* dl, uint32_t maxSize );
+
+/*
+** Set up a size x size view with the map centered in it. The border is a
+** fixed part of the size, so a view twice the size puts everything exactly
+** twice as far from the top left corner.
+*/
+void MapView_SetupSquare( mapview_t* view, const displaylist_t* dl, uint32_t size );
+
+/*
+** Transform all of a display list's vertexes and markers into image space.
+** The display list itself isn't changed.
+*/
+void MapView_Transform( mapview_t* view, const displaylist_t* dl );
+
+/*
+** Free the transformed positions
+*/
+void MapView_Free( mapview_t* view );
+
+#endif
@@ -0,0 +1,64 @@
+/*
+** out_sink.c
+**
+** Where output goes: a write callback, with ready made ones for files and
+** growable memory buffers
+*/
+
+#include "out_sink.h"
+
+static uint8_t WriteFile( void* ctx, const void* data, size_t len ) {
+    return fwrite( data, 1, len, (FILE*)ctx ) == len;
+}
+
+static uint8_t WriteMemory( void* ctx, const void* data, size_t len ) {
+    membuf_t* buf = (membuf_t*)ctx;
+
+    if ( len > buf->capacity - buf->size ) {
+        size_t capacity = (buf->capacity > 0) ? buf->capacity : 4096;
+        uint8_t* grown = NULL;
+        while ( capacity - buf->size < len ) {
+            capacity *= 2;
+        }
+        grown = (uint8_t*)realloc( buf->data, capacity );
+        if ( grown == NULL ) {
+            return 0;
+        }
+        buf->data = grown;
+        buf->capacity = capacity;
+    }
+    memcpy( buf->data + buf->size, data, len );
+    buf->size += len;
+    return 1;
+}
+
+/*
+** Get a sink writing to an open file
+*/
+outsink_t Sink_File( FILE* f ) {
+    outsink_t sink;
+
+    sink.write = WriteFile;
+    sink.ctx = f;
+    return sink;
+}
+
+/*
+** Get a sink appending to a memory buffer
+*/
+outsink_t Sink_Memory( membuf_t* buf ) {
+    outsink_t sink;
+
+    sink.write = WriteMemory;
+    sink.ctx = buf;
+    return sink;
+}
+
+/*
+** Free a memory buffer's data
+*/
+void MemBuf_Free( membuf_t* buf ) {
+    free( buf->data );
+    buf->data = NULL;
+    buf->size = buf->capacity = 0;
+}
@@ -0,0 +1,43 @@
+/*
+** out_sink.h
+**
+** Where output goes: a write callback, with ready made ones for files and
+** growable memory buffers
+*/
+
+#ifndef __OUT_SINK_H
+#define __OUT_SINK_H
+
+#include "shared.h"
+
+// Write len bytes, returns 0 on failure
+typedef uint8_t (*sinkwrite_t)( void* ctx, const void* data, size_t len );
+
+typedef struct {
+    sinkwrite_t write;
+    void*       ctx; // Passed to write
+} outsink_t;
+
+// Memory the output is appended to, grown as needed
+typedef struct {
+    uint8_t* data;
+    size_t   size, capacity;
+} membuf_t;
+
+/*
+** Get a sink writing to an open file. The caller closes the file.
+*/
+outsink_t Sink_File( FILE* f );
+
+/*
+** Get a sink appending to a memory buffer. The buffer must be zeroed or
+** have been used before, and is freed with MemBuf_Free.
+*/
+outsink_t Sink_Memory( membuf_t* buf );
+
+/*
+** Free a memory buffer's data
+*/
+void MemBuf_Free( membuf_t* buf );
+
+#endif
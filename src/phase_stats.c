@@ -0,0 +1,157 @@
+/*
+** phase_stats.c
+**
+** Time, CPU, reads, allocations and memory use of each phase of the work,
+** for the whole WAD and for each map
+*/
+
+#include "phase_stats.h"
+#include <time.h>
+#include <sys/resource.h>
+
+static const char* const phaseNames[NUM_PHASES] = {
+    "directory", "things", "linedefs", "sidedefs", "vertexes", "sectors",
+    "classify", "render", "encode", "count", "output"
+};
+
+static uint8_t statsEnabled = 0;
+static clockid_t cpuClock = CLOCK_PROCESS_CPUTIME_ID;
+
+// Everything that changes as a thread works is kept per thread, so
+// counting never needs a lock
+static __thread statsrecord_t* threadRecord = NULL;
+static __thread phasetimer_t* threadTimer = NULL; // Innermost phase
+static __thread uint64_t threadRead = 0;
+static __thread uint64_t threadAllocs = 0;
+
+static double Seconds( clockid_t clock ) {
+    struct timespec ts;
+    clock_gettime( clock, &ts );
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void Stats_Enable( uint8_t threadCpu ) {
+    statsEnabled = 1;
+    cpuClock = threadCpu ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID;
+}
+
+uint8_t Stats_Enabled( void ) {
+    return statsEnabled;
+}
+
+statsrecord_t* Stats_SetRecord( statsrecord_t* record ) {
+    statsrecord_t* prev = threadRecord;
+    if ( statsEnabled ) {
+        threadRecord = record;
+    }
+    return prev;
+}
+
+statsrecord_t* Stats_GetRecord( void ) {
+    return threadRecord;
+}
+
+void Stats_Begin( phasetimer_t* timer, phase_t phase ) {
+    timer->record = threadRecord;
+    if ( timer->record == NULL ) {
+        return;
+    }
+    timer->phase = phase;
+    timer->parent = threadTimer;
+    timer->wall = Seconds( CLOCK_MONOTONIC );
+    timer->cpu = Seconds( cpuClock );
+    timer->bytesRead = threadRead;
+    timer->allocs = threadAllocs;
+    timer->childWall = timer->childCpu = 0.0;
+    timer->childRead = timer->childAllocs = 0;
+    threadTimer = timer;
+}
+
+void Stats_End( phasetimer_t* timer ) {
+    phasestats_t* ps = NULL;
+    struct rusage usage;
+    double wall = 0.0, cpu = 0.0;
+    uint64_t bytesRead = 0, allocs = 0;
+
+    if ( timer->record == NULL ) {
+        return;
+    }
+    wall = Seconds( CLOCK_MONOTONIC ) - timer->wall;
+    cpu = Seconds( cpuClock ) - timer->cpu;
+    bytesRead = threadRead - timer->bytesRead;
+    allocs = threadAllocs - timer->allocs;
+
+    // Nested phases have already been counted
+    ps = &timer->record->phases[timer->phase];
+    ++ps->calls;
+    ps->wall += wall - timer->childWall;
+    ps->cpu += cpu - timer->childCpu;
+    ps->bytesRead += bytesRead - timer->childRead;
+    ps->allocs += allocs - timer->childAllocs;
+    getrusage( RUSAGE_SELF, &usage );
+    if ( (uint64_t)usage.ru_maxrss > ps->peakRSS ) {
+        ps->peakRSS = (uint64_t)usage.ru_maxrss;
+    }
+
+    threadTimer = timer->parent;
+    if ( threadTimer != NULL ) {
+        threadTimer->childWall += wall;
+        threadTimer->childCpu += cpu;
+        threadTimer->childRead += bytesRead;
+        threadTimer->childAllocs += allocs;
+    }
+}
+
+void Stats_AddRead( uint64_t bytes ) {
+    threadRead += bytes;
+}
+
+void Stats_AddAlloc( void ) {
+    ++threadAllocs;
+}
+
+void Stats_Merge( statsrecord_t* into, const statsrecord_t* from ) {
+    uint32_t p = 0;
+
+    for ( p = 0; p < NUM_PHASES; ++p ) {
+        phasestats_t* a = &into->phases[p];
+        const phasestats_t* b = &from->phases[p];
+        a->calls += b->calls;
+        a->wall += b->wall;
+        a->cpu += b->cpu;
+        a->bytesRead += b->bytesRead;
+        a->allocs += b->allocs;
+        if ( b->peakRSS > a->peakRSS ) {
+            a->peakRSS = b->peakRSS;
+        }
+    }
+}
+
+void Stats_Print( FILE* f, const char* title, const statsrecord_t* record ) {
+    phasestats_t total;
+    uint32_t p = 0;
+
+    memset( &total, 0, sizeof(total) );
+    fprintf( f, "%s\n%-10s %7s %11s %11s %12s %9s %12s\n", title, "phase", "calls",
+             "wall ms", "cpu ms", "read KB", "allocs", "peak RSS KB" );
+    for ( p = 0; p < NUM_PHASES; ++p ) {
+        const phasestats_t* ps = &record->phases[p];
+        if ( ps->calls == 0 ) {
+            continue;
+        }
+        fprintf( f, "%-10s %7u %11.3f %11.3f %12.1f %9llu %12llu\n", phaseNames[p],
+                 ps->calls, ps->wall * 1e3, ps->cpu * 1e3, ps->bytesRead / 1024.0,
+                 (unsigned long long)ps->allocs, (unsigned long long)ps->peakRSS );
+        total.calls += ps->calls;
+        total.wall += ps->wall;
+        total.cpu += ps->cpu;
+        total.bytesRead += ps->bytesRead;
+        total.allocs += ps->allocs;
+        if ( ps->peakRSS > total.peakRSS ) {
+            total.peakRSS = ps->peakRSS;
+        }
+    }
+    fprintf( f, "%-10s %7u %11.3f %11.3f %12.1f %9llu %12llu\n\n", "total",
+             total.calls, total.wall * 1e3, total.cpu * 1e3, total.bytesRead / 1024.0,
+             (unsigned long long)total.allocs, (unsigned long long)total.peakRSS );
+}
@@ -0,0 +1,113 @@
+/*
+** phase_stats.h
+**
+** Time, CPU, reads, allocations and memory use of each phase of the work,
+** for the whole WAD and for each map
+*/
+
+#ifndef __PHASE_STATS_H
+#define __PHASE_STATS_H
+
+#include "shared.h"
+
+// Phases of the work
+typedef enum {
+    PHASE_DIRECTORY, // Loading the lump directory and finding the maps
+    PHASE_THINGS,    // Reading each map lump
+    PHASE_LINEDEFS,
+    PHASE_SIDEDEFS,
+    PHASE_VERTEXES,
+    PHASE_SECTORS,
+    PHASE_CLASSIFY,  // Building the display list and styling the lines
+    PHASE_RENDER,    // Drawing the images
+    PHASE_ENCODE,    // Writing the PNG, QOI, PPM, raw and SVG data
+    PHASE_COUNT,     // Counting things
+    PHASE_OUTPUT,    // The dump or printout
+    NUM_PHASES
+} phase_t;
+
+// What was spent on a phase
+typedef struct {
+    uint32_t calls;
+    double   wall;      // Seconds
+    double   cpu;       // Seconds of CPU time
+    uint64_t bytesRead; // Read from the WAD
+    uint64_t allocs;    // Buffers allocated by wadslip itself, not cairo or libpng
+    uint64_t peakRSS;   // Peak resident size of the process so far, in KB
+} phasestats_t;
+
+// Stats of every phase for the WAD or one map
+typedef struct {
+    char         name[8]; // Map name, empty for the WAD as a whole
+    phasestats_t phases[NUM_PHASES];
+} statsrecord_t;
+
+// A phase being timed. Phases can nest, and the time of an inner phase
+// isn't counted again in the outer one, so the phases add up to the total.
+typedef struct phasetimer_s {
+    struct phasetimer_s* parent; // Phase this one is inside
+    statsrecord_t* record;       // Where it's counted, NULL if it isn't
+    phase_t  phase;
+    double   wall, cpu;          // At the start
+    uint64_t bytesRead, allocs;  // At the start
+    double   childWall, childCpu; // Spent in nested phases
+    uint64_t childRead, childAllocs;
+} phasetimer_t;
+
+/*
+** Turn stats on. Each thread's CPU time is used if threadCpu is set,
+** which is right when every map is drawn on a single thread. Otherwise
+** the whole process's CPU time is used, so helper threads are included.
+*/
+void Stats_Enable( uint8_t threadCpu );
+
+/*
+** Are stats on?
+*/
+uint8_t Stats_Enabled( void );
+
+/*
+** Set the record the calling thread's phases are counted in, NULL for none.
+** Returns the record it had before. Does nothing while stats are off.
+*/
+statsrecord_t* Stats_SetRecord( statsrecord_t* record );
+
+/*
+** Get the record the calling thread's phases are counted in, so another
+** thread can count work it does on this one's behalf
+*/
+statsrecord_t* Stats_GetRecord( void );
+
+/*
+** Start timing a phase on the calling thread
+*/
+void Stats_Begin( phasetimer_t* timer, phase_t phase );
+
+/*
+** Finish timing a phase and add it to the record
+*/
+void Stats_End( phasetimer_t* timer );
+
+/*
+** Count bytes read from the WAD by the calling thread
+*/
+void Stats_AddRead( uint64_t bytes );
+
+/*
+** Count a buffer allocated by the calling thread. Called where wadslip
+** makes its own allocations: the map arena, display lists, map views,
+** framebuffers, image streams, writers and the lump directory.
+*/
+void Stats_AddAlloc( void );
+
+/*
+** Add one record to another
+*/
+void Stats_Merge( statsrecord_t* into, const statsrecord_t* from );
+
+/*
+** Print a record as a table, one row per phase that ran
+*/
+void Stats_Print( FILE* f, const char* title, const statsrecord_t* record );
+
+#endif
@@ -0,0 +1,262 @@
+/*
+** raster.c
+**
+** A simple software rasterizer drawing into an RGBA framebuffer
+*/
+
+#include "raster.h"
+#include "phase_stats.h"
+#include <math.h>
+
+/*
+** Allocate a framebuffer and fill it with a color
+*/
+void FB_Init( framebuffer_t* fb, uint32_t width, uint32_t height, color_t bg ) {
+    fb->width = width;
+    fb->height = height;
+    fb->originX = fb->originY = 0;
+    fb->pixels = (uint8_t*)malloc( (size_t)width * height * 4 + 1 );
+    if ( fb->pixels == NULL ) {
+        fprintf( stderr, "Error allocating %ux%u framebuffer!\n", width, height );
+        exit( EXIT_FAILURE );
+    }
+    Stats_AddAlloc();
+    FB_Clear( fb, bg );
+}
+
+/*
+** Fill a whole framebuffer with a color
+*/
+void FB_Clear( framebuffer_t* fb, color_t bg ) {
+    size_t p = 0, numPixels = (size_t)fb->width * fb->height;
+    for ( p = 0; p < numPixels; ++p ) {
+        fb->pixels[p * 4] = bg.r;
+        fb->pixels[p * 4 + 1] = bg.g;
+        fb->pixels[p * 4 + 2] = bg.b;
+        fb->pixels[p * 4 + 3] = 255;
+    }
+}
+
+/*
+** Free a framebuffer
+*/
+void FB_Free( framebuffer_t* fb ) {
+    free( fb->pixels );
+    fb->pixels = NULL;
+    fb->width = fb->height = 0;
+}
+
+// Blend a color into a pixel with a coverage of 0 to 256. The position is
+// in image space and the caller makes sure it's inside the framebuffer.
+static void BlendPixel( framebuffer_t* fb, int64_t x, int64_t y, color_t c,
+                        uint32_t cov ) {
+    uint8_t* p = fb->pixels + ((size_t)(y - fb->originY) * fb->width +
+                               (size_t)(x - fb->originX)) * 4;
+    if ( cov >= 256 ) {
+        p[0] = c.r; p[1] = c.g; p[2] = c.b;
+    } else {
+        p[0] = (uint8_t)((p[0] * (256 - cov) + c.r * cov) >> 8);
+        p[1] = (uint8_t)((p[1] * (256 - cov) + c.g * cov) >> 8);
+        p[2] = (uint8_t)((p[2] * (256 - cov) + c.b * cov) >> 8);
+    }
+}
+
+// Plain Bresenham for thin aliased lines. Where the line is on the minor
+// axis at any step can be worked out directly, so only the steps inside the
+// framebuffer are walked, and a line split across several framebuffers
+// comes out exactly the same as if it were drawn in one.
+static void DrawLineBresenham( framebuffer_t* fb, int32_t x0, int32_t y0,
+                               int32_t x1, int32_t y1, color_t c ) {
+    uint8_t steep = abs( y1 - y0 ) > abs( x1 - x0 );
+    int32_t major0 = steep ? y0 : x0, minor0 = steep ? x0 : y0;
+    int32_t dMajor = steep ? y1 - y0 : x1 - x0, dMinor = steep ? x1 - x0 : y1 - y0;
+    int32_t sMajor = (dMajor < 0) ? -1 : 1, sMinor = (dMinor < 0) ? -1 : 1;
+    // Image space bounds of the framebuffer on each axis
+    int64_t majorLo = steep ? fb->originY : fb->originX;
+    int64_t majorHi = majorLo + (steep ? fb->height : fb->width) - 1;
+    int64_t minorLo = steep ? fb->originX : fb->originY;
+    int64_t minorHi = minorLo + (steep ? fb->width : fb->height) - 1;
+    int64_t step = 0, stepStart = 0, stepEnd = 0, err = 0, minor = 0, lo = 0, hi = 0;
+
+    dMajor = abs( dMajor );
+    dMinor = abs( dMinor );
+    stepEnd = dMajor;
+    // Steps where the major axis is inside the framebuffer
+    lo = (sMajor > 0) ? majorLo - major0 : major0 - majorHi;
+    hi = (sMajor > 0) ? majorHi - major0 : major0 - majorLo;
+    stepStart = (lo > stepStart) ? lo : stepStart;
+    stepEnd = (hi < stepEnd) ? hi : stepEnd;
+    // And the minor axis. The minor offset after n steps is
+    // (2 * n * dMinor + dMajor) / (2 * dMajor).
+    if ( dMinor > 0 ) {
+        lo = (sMinor > 0) ? minorLo - minor0 : minor0 - minorHi;
+        hi = (sMinor > 0) ? minorHi - minor0 : minor0 - minorLo;
+        if ( lo > 0 ) {
+            // First step with an offset of at least lo
+            int64_t first = (2 * dMajor * lo - dMajor + 2 * dMinor - 1) / (2 * dMinor);
+            stepStart = (first > stepStart) ? first : stepStart;
+        }
+        if ( hi < 0 ) {
+            return;
+        }
+        // Last step with an offset of at most hi
+        lo = (2 * dMajor * (hi + 1) - dMajor - 1) / (2 * dMinor);
+        stepEnd = (lo < stepEnd) ? lo : stepEnd;
+    } else if ( minor0 < minorLo || minor0 > minorHi ) {
+        return;
+    }
+    if ( stepStart > stepEnd ) {
+        return;
+    }
+
+    minor = (dMajor > 0) ? (2 * stepStart * dMinor + dMajor) / (2 * dMajor) : 0;
+    err = (dMajor > 0) ? (2 * stepStart * dMinor + dMajor) % (2 * dMajor) : 0;
+    for ( step = stepStart; step <= stepEnd; ++step ) {
+        int64_t ma = major0 + step * sMajor, mi = minor0 + minor * sMinor;
+        if ( mi >= minorLo && mi <= minorHi ) {
+            if ( steep ) {
+                BlendPixel( fb, mi, ma, c, 256 );
+            } else {
+                BlendPixel( fb, ma, mi, c, 256 );
+            }
+        }
+        err += 2 * dMinor;
+        if ( err >= 2 * dMajor ) {
+            err -= 2 * dMajor;
+            ++minor;
+        }
+    }
+}
+
+/*
+** Draw a line between two points in image space
+*/
+void FB_DrawLine( framebuffer_t* fb, float x0, float y0, float x1, float y1,
+                  color_t color, float width, uint8_t antiAlias ) {
+    uint8_t steep = fabsf( y1 - y0 ) > fabsf( x1 - x0 );
+    int32_t major = 0, majorStart = 0, majorEnd = 0;
+    int32_t majorLo = 0, majorHi = 0, minorLo = 0, minorHi = 0;
+    float t = 0.0f, slope = 0.0f, half = 0.0f, lo = 0.0f, hi = 0.0f;
+
+    if ( !antiAlias && width <= 1.0f ) {
+        DrawLineBresenham( fb, (int32_t)floorf( x0 ), (int32_t)floorf( y0 ),
+                           (int32_t)floorf( x1 ), (int32_t)floorf( y1 ), color );
+        return;
+    }
+
+    // Walk along the major axis, so swap x and y for steep lines
+    if ( steep ) {
+        t = x0; x0 = y0; y0 = t;
+        t = x1; x1 = y1; y1 = t;
+    }
+    if ( x0 > x1 ) {
+        t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+    }
+    // Image space bounds of the framebuffer on each axis
+    majorLo = steep ? fb->originY : fb->originX;
+    majorHi = majorLo + (int32_t)(steep ? fb->height : fb->width) - 1;
+    minorLo = steep ? fb->originX : fb->originY;
+    minorHi = minorLo + (int32_t)(steep ? fb->width : fb->height) - 1;
+    slope = (x1 > x0) ? (y1 - y0) / (x1 - x0) : 0.0f;
+    // Thickness of the line measured along the minor axis
+    half = 0.5f * ((width < 1.0f) ? 1.0f : width) * sqrtf( 1.0f + slope * slope );
+
+    // Only draw the columns with their centers on the line, so lines that
+    // share an end don't both draw it. Lines too short to cover a center
+    // get a single column.
+    lo = ceilf( x0 - 0.5f );
+    hi = ceilf( x1 - 0.5f ) - 1.0f;
+    if ( hi < lo ) {
+        lo = hi = floorf( (x0 + x1) * 0.5f );
+    }
+    // And only the part that's inside the framebuffer
+    if ( slope != 0.0f ) {
+        // Where the line's span crosses the top and bottom of the framebuffer
+        float a = x0 + ((float)minorLo - half - 1.0f - y0) / slope - 0.5f;
+        float b = x0 + ((float)minorHi + half + 2.0f - y0) / slope - 0.5f;
+        if ( a > b ) {
+            t = a; a = b; b = t;
+        }
+        lo = (floorf( a ) > lo) ? floorf( a ) : lo;
+        hi = (ceilf( b ) < hi) ? ceilf( b ) : hi;
+    } else if ( y0 + half < (float)minorLo || y0 - half > (float)minorHi + 1.0f ) {
+        return;
+    }
+    // Clamp before converting so far off lines can't overflow
+    lo = (lo < (float)majorLo) ? (float)majorLo : lo;
+    hi = (hi > (float)majorHi) ? (float)majorHi : hi;
+    if ( lo > hi ) {
+        return;
+    }
+    majorStart = (int32_t)lo;
+    majorEnd = (int32_t)hi;
+
+    for ( major = majorStart; major <= majorEnd; ++major ) {
+        // Span of the line across the minor axis at this pixel's center
+        float center = y0 + ((float)major + 0.5f - x0) * slope;
+        float top = center - half, bottom = center + half;
+        int32_t minor = 0, minorStart = 0, minorEnd = 0;
+
+        if ( antiAlias ) {
+            // Each pixel gets the part of the span that covers it
+            minorStart = (int32_t)floorf( top );
+            minorEnd = (int32_t)ceilf( bottom ) - 1;
+        } else {
+            minorStart = (int32_t)floorf( top + 0.5f );
+            minorEnd = (int32_t)floorf( bottom + 0.5f ) - 1;
+            if ( minorEnd < minorStart ) {
+                minorStart = minorEnd = (int32_t)floorf( center );
+            }
+        }
+        if ( minorStart < minorLo ) {
+            minorStart = minorLo;
+        }
+        if ( minorEnd > minorHi ) {
+            minorEnd = minorHi;
+        }
+        for ( minor = minorStart; minor <= minorEnd; ++minor ) {
+            uint32_t cov = 256;
+            if ( antiAlias ) {
+                float lo = (top > (float)minor) ? top : (float)minor;
+                float hi = (bottom < (float)minor + 1.0f) ? bottom : (float)minor + 1.0f;
+                cov = (uint32_t)((hi - lo) * 256.0f + 0.5f);
+                if ( cov == 0 ) {
+                    continue;
+                }
+            }
+            if ( steep ) {
+                BlendPixel( fb, minor, major, color, cov );
+            } else {
+                BlendPixel( fb, major, minor, color, cov );
+            }
+        }
+    }
+}
+
+/*
+** Fill a rectangle
+*/
+void FB_FillRect( framebuffer_t* fb, float x, float y, float w, float h,
+                  color_t color ) {
+    int32_t x0 = (int32_t)floorf( x + 0.5f ), x1 = (int32_t)floorf( x + w + 0.5f );
+    int32_t y0 = (int32_t)floorf( y + 0.5f ), y1 = (int32_t)floorf( y + h + 0.5f );
+    int32_t px = 0, py = 0;
+
+    // Always fill at least one pixel so tiny things still show up
+    if ( x1 <= x0 ) {
+        x1 = x0 + 1;
+    }
+    if ( y1 <= y0 ) {
+        y1 = y0 + 1;
+    }
+    if ( x0 < fb->originX ) x0 = fb->originX;
+    if ( y0 < fb->originY ) y0 = fb->originY;
+    if ( x1 > fb->originX + (int32_t)fb->width ) x1 = fb->originX + (int32_t)fb->width;
+    if ( y1 > fb->originY + (int32_t)fb->height ) y1 = fb->originY + (int32_t)fb->height;
+    for ( py = y0; py < y1; ++py ) {
+        for ( px = x0; px < x1; ++px ) {
+            BlendPixel( fb, px, py, color, 256 );
+        }
+    }
+}
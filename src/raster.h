@@ -0,0 +1,48 @@
+/*
+** raster.h
+**
+** A simple software rasterizer drawing into an RGBA framebuffer
+*/
+
+#ifndef __RASTER_H
+#define __RASTER_H
+
+#include "shared.h"
+
+// RGBA framebuffer, 4 bytes per pixel, rows top to bottom. A framebuffer
+// can hold just part of an image, everything is drawn in image space.
+typedef struct {
+    uint32_t width, height;
+    int32_t  originX, originY; // Image position of the top left pixel
+    uint8_t* pixels;
+} framebuffer_t;
+
+/*
+** Allocate a framebuffer and fill it with a color
+*/
+void FB_Init( framebuffer_t* fb, uint32_t width, uint32_t height, color_t bg );
+
+/*
+** Fill a whole framebuffer with a color
+*/
+void FB_Clear( framebuffer_t* fb, color_t bg );
+
+/*
+** Free a framebuffer
+*/
+void FB_Free( framebuffer_t* fb );
+
+/*
+** Draw a line between two points in image space. Anti-aliased lines use
+** Wu style coverage, aliased lines of width 1 or less use Bresenham.
+*/
+void FB_DrawLine( framebuffer_t* fb, float x0, float y0, float x1, float y1,
+                  color_t color, float width, uint8_t antiAlias );
+
+/*
+** Fill a rectangle
+*/
+void FB_FillRect( framebuffer_t* fb, float x, float y, float w, float h,
+                  color_t color );
+
+#endif
@@ -9,6 +9,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "wad_types.h" // stdint.h is here so we wont include it again
 #include "iniparser/iniparser.h"
 
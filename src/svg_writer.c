@@ -0,0 +1,134 @@
+/*
+** svg_writer.c
+**
+** Writes a display list straight to an SVG document
+*/
+
+#include "svg_writer.h"
+#include "buf_writer.h"
+
+// Writes path data
+typedef struct {
+    bufwriter_t* bw;
+    uint8_t      decimals;
+    uint8_t      open;     // Is a path element open?
+} svgpath_t;
+
+static void BeginPath( svgpath_t* path, uint8_t style ) {
+    BW_PutStr( path->bw, "<path class=\"s" );
+    BW_PutInt( path->bw, style );
+    BW_PutStr( path->bw, "\" d=\"" );
+    path->open = 1;
+}
+
+static void EndPath( svgpath_t* path ) {
+    if ( path->open ) {
+        BW_PutStr( path->bw, "\"/>\n" );
+        path->open = 0;
+    }
+}
+
+static void PutPoint( svgpath_t* path, char command, const float* verts, uint32_t v ) {
+    BW_PutChar( path->bw, command );
+    BW_PutFixed( path->bw, verts[v * 2], path->decimals );
+    BW_PutChar( path->bw, ' ' );
+    BW_PutFixed( path->bw, verts[v * 2 + 1], path->decimals );
+}
+
+// Every line is its own subpath, like the separate strokes cairo draws, so
+// there are butt caps at both ends instead of joins where lines meet. A
+// point straight after a move is a line to it, so no L is needed.
+static void AddLine( svgpath_t* path, const float* verts, const dlline_t* line ) {
+    PutPoint( path, 'M', verts, line->v1 );
+    PutPoint( path, ' ', verts, line->v2 );
+}
+
+/*
+** Write a display list to an SVG document
+*/
+uint8_t WriteMapSVG( const displaylist_t* dl, const drawsettings_t* settings,
+                     const mapview_t* view, color_t bgColor, const outsink_t* sink ) {
+    bufwriter_t* bw = BW_OpenSink( sink );
+    svgpath_t path;
+    uint32_t i = 0, s = 0;
+
+    if ( bw == NULL ) {
+        return 0;
+    }
+    path.bw = bw;
+    path.decimals = settings->svgDecimals;
+    path.open = 0;
+
+    BW_PutStr( bw, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                   "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" );
+    BW_PutInt( bw, view->width );
+    BW_PutStr( bw, "\" height=\"" );
+    BW_PutInt( bw, view->height );
+    BW_PutStr( bw, "\" viewBox=\"0 0 " );
+    BW_PutInt( bw, view->width );
+    BW_PutChar( bw, ' ' );
+    BW_PutInt( bw, view->height );
+    BW_PutChar( bw, '"' );
+    if ( !settings->antiAlias ) {
+        BW_PutStr( bw, " shape-rendering=\"crispEdges\"" );
+    }
+    BW_PutStr( bw, ">\n<style>path{fill:none;stroke-width:" );
+    BW_PutFixed( bw, settings->lineWidth, 3 );
+    BW_PutChar( bw, '}' );
+    for ( s = 0; s < LS_NUMSTYLES; ++s ) {
+        BW_PutStr( bw, ".s" );
+        BW_PutInt( bw, s );
+        BW_PutStr( bw, "{stroke:" );
+        BW_PutColor( bw, GetLineStyleColor( (linestyle_t)s ) );
+        BW_PutChar( bw, '}' );
+    }
+    BW_PutStr( bw, "</style>\n<rect width=\"100%\" height=\"100%\" fill=\"" );
+    BW_PutColor( bw, bgColor );
+    BW_PutStr( bw, "\"/>\n" );
+
+    // Draw the map's lines
+    if ( settings->batchPaths ) {
+        // One path for each style
+        for ( s = 0; s < LS_NUMSTYLES; ++s ) {
+            if ( dl->styleStarts[s] == dl->styleStarts[s + 1] ) {
+                continue;
+            }
+            BeginPath( &path, (uint8_t)s );
+            for ( i = dl->styleStarts[s]; i < dl->styleStarts[s + 1]; ++i ) {
+                AddLine( &path, view->verts, &dl->lines[dl->byStyle[i]] );
+            }
+            EndPath( &path );
+        }
+    } else {
+        // Lines stay in order, so a new path starts whenever the style changes
+        for ( i = 0; i < dl->numlines; ++i ) {
+            const dlline_t* line = &dl->lines[i];
+            if ( i == 0 || line->style != dl->lines[i - 1].style ) {
+                EndPath( &path );
+                BeginPath( &path, line->style );
+            }
+            AddLine( &path, view->verts, line );
+        }
+        EndPath( &path );
+    }
+
+    // Draw the map's thing markers
+    for ( i = 0; i < dl->nummarkers; ++i ) {
+        const dlmarker_t* marker = &dl->markers[i];
+        double radius = marker->radius * view->scale;
+        BW_PutStr( bw, "<rect x=\"" );
+        BW_PutFixed( bw, view->markers[i * 2] - radius, path.decimals );
+        BW_PutStr( bw, "\" y=\"" );
+        BW_PutFixed( bw, view->markers[i * 2 + 1] - radius, path.decimals );
+        BW_PutStr( bw, "\" width=\"" );
+        BW_PutFixed( bw, radius * 2, path.decimals );
+        BW_PutStr( bw, "\" height=\"" );
+        BW_PutFixed( bw, radius * 2, path.decimals );
+        BW_PutStr( bw, "\" fill=\"" );
+        BW_PutColor( bw, marker->color );
+        BW_PutStr( bw, "\"/>\n" );
+    }
+
+    BW_PutStr( bw, "</svg>\n" );
+    return BW_Close( bw );
+}
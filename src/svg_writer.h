@@ -0,0 +1,23 @@
+/*
+** svg_writer.h
+**
+** Writes a display list straight to an SVG document
+*/
+
+#ifndef __SVG_WRITER_H
+#define __SVG_WRITER_H
+
+#include "shared.h"
+#include "map_drawer.h"
+#include "map_view.h"
+#include "out_sink.h"
+
+/*
+** Write a display list as seen in a view to a sink as an SVG document.
+** Each line style gets a CSS class and runs of lines of one style share a
+** path. Returns 0 if the document couldn't be written.
+*/
+uint8_t WriteMapSVG( const displaylist_t* dl, const drawsettings_t* settings,
+                     const mapview_t* view, color_t bgColor, const outsink_t* sink );
+
+#endif
@@ -6,156 +6,211 @@
 
 #include "thing_counter.h"
 
-// Thing counts
-typedef struct {
-    uint16_t easy, normal, hard;
-} thingCount_t;
+// Pack a category and index into one table entry, 0 is left for things
+// that aren't counted
+#define KIND(cat, index) ((uint8_t)(((cat) + 1) << 5 | (index)))
 
-// Thing category
-typedef enum {MONSTER, POWERUP, WEAPON, AMMO, KEY} thingCat_t;
+// Number of entries in the table of thing types
+#define NUM_THING_TYPES 3007
 
-// Monster names
+// Category and index of every counted thing type
+static const uint8_t thingTable[NUM_THING_TYPES] = {
+    // Monsters
+    [68] = KIND(MONSTER, 0),    // Arachnotron
+    [64] = KIND(MONSTER, 1),    // Arch-Vile
+    [3003] = KIND(MONSTER, 2),  // Baron of Hell
+    [3005] = KIND(MONSTER, 3),  // Cacodemon
+    [72] = KIND(MONSTER, 4),    // Commander Keen
+    [16] = KIND(MONSTER, 5),    // Cyberdemon
+    [3002] = KIND(MONSTER, 6),  // Demon
+    [65] = KIND(MONSTER, 7),    // Heavy Weapon Dude
+    [69] = KIND(MONSTER, 8),    // Hell Knight
+    [3001] = KIND(MONSTER, 9),  // Imp
+    [3006] = KIND(MONSTER, 10), // Lost Soul
+    [67] = KIND(MONSTER, 11),   // Mancubus
+    [71] = KIND(MONSTER, 12),   // Pain Elemental
+    [66] = KIND(MONSTER, 13),   // Revenant
+    [9] = KIND(MONSTER, 14),    // Shotgun Guy
+    [58] = KIND(MONSTER, 15),   // Spectre
+    [7] = KIND(MONSTER, 16),    // Spiderdemon
+    [84] = KIND(MONSTER, 17),   // Wolfenstein SS
+    [3004] = KIND(MONSTER, 18), // Zombieman
+    [88] = KIND(MONSTER, 19),   // Boss brain
+    // Powerups
+    [2015] = KIND(POWERUP, 0),  // Armor bonus
+    [8] = KIND(POWERUP, 1),     // Backpack
+    [2023] = KIND(POWERUP, 2),  // Berserk pack
+    [2019] = KIND(POWERUP, 3),  // Blue armor
+    [2026] = KIND(POWERUP, 4),  // Computer map
+    [2018] = KIND(POWERUP, 5),  // Green armor
+    [2014] = KIND(POWERUP, 6),  // Health bonus
+    [2024] = KIND(POWERUP, 7),  // Invisibility
+    [2022] = KIND(POWERUP, 8),  // Invulnerability
+    [2045] = KIND(POWERUP, 9),  // Light goggles
+    [2012] = KIND(POWERUP, 10), // Medikit
+    [83] = KIND(POWERUP, 11),   // Megasphere
+    [2025] = KIND(POWERUP, 12), // Radiation suit
+    [2013] = KIND(POWERUP, 13), // Soul sphere
+    [2011] = KIND(POWERUP, 14), // Stimpack
+    // Weapons
+    [2006] = KIND(WEAPON, 0),   // BFG9000
+    [2002] = KIND(WEAPON, 1),   // Chaingun
+    [2005] = KIND(WEAPON, 2),   // Chainsaw
+    [2004] = KIND(WEAPON, 3),   // Plasma gun
+    [2003] = KIND(WEAPON, 4),   // Rocket launcher
+    [2001] = KIND(WEAPON, 5),   // Shotgun
+    [82] = KIND(WEAPON, 6),     // Super shotgun
+    // Ammo
+    [2048] = KIND(AMMO, 0),     // Box of bullets
+    [2046] = KIND(AMMO, 1),     // Box of rockets
+    [2049] = KIND(AMMO, 2),     // Box of shells
+    [2047] = KIND(AMMO, 3),     // Cell
+    [17] = KIND(AMMO, 4),       // Cell pack
+    [2007] = KIND(AMMO, 5),     // Clip
+    [2010] = KIND(AMMO, 6),     // Rocket
+    [2008] = KIND(AMMO, 7),     // Shells
+    // Keys
+    [5] = KIND(KEY, 0),         // Blue keycard
+    [40] = KIND(KEY, 1),        // Blue skull key
+    [13] = KIND(KEY, 2),        // Red keycard
+    [38] = KIND(KEY, 3),        // Red skull key
+    [6] = KIND(KEY, 4),         // Yellow keycard
+    [39] = KIND(KEY, 5)         // Yellow skull key
+};
+
+// Names of each category's things, in index order
 static const char* monsterNames[] = {
     "Arachnotrons", "Arch-Viles", "Barons of Hell", "Cacodemons",
     "Commander Keens", "Cyberdemons", "Demons", "Heavy Weapon Dudes",
     "Hell Knights", "Imps", "Lost Souls", "Mancubi", "Pain Elementals",
     "Revenants", "Shotgun Guys", "Spectres", "Spiderdemons", "Wolfenstein SS",
-    "Zombiemen", "Boss Brains"
+    "Zombiemen", "Boss Brains", NULL
 };
-// Powerup names
 static const char* powerupNames[] = {
     "Armor bonuses", "Backpacks", "Berserk packs", "Blue armors",
     "Computer maps", "Green armors", "Health bonuses", "Invisibilities",
     "Invulnerabilities", "Light goggles", "Medikits", "Megaspheres",
-    "Radiation suits", "Soul spheres", "Stimpacks"
+    "Radiation suits", "Soul spheres", "Stimpacks", NULL
+};
+static const char* weaponNames[] = {
+    "BFG9000s", "Chainguns", "Chainsaws", "Plasma guns", "Rocket launchers",
+    "Shotguns", "Super shotguns", NULL
+};
+static const char* ammoNames[] = {
+    "Boxes of bullets", "Boxes of rockets", "Boxes of shells", "Cells",
+    "Cell packs", "Clips", "Rockets", "Shells", NULL
+};
+static const char* keyNames[] = {
+    "Blue keycards", "Blue skull keys", "Red keycards", "Red skull keys",
+    "Yellow keycards", "Yellow skull keys", NULL
+};
+static const char** const catNames[NUMTHINGCATS] = {
+    monsterNames, powerupNames, weaponNames, ammoNames, keyNames
+};
+static const char* const catTitles[NUMTHINGCATS] = {
+    "monster", "powerup", "weapon", "ammo", "key"
 };
 
-static thingCat_t thingCat = MONSTER;
-static thingCount_t monsterCounts[20] = {0, 0, 0};
-static thingCount_t powerupCounts[15] = {0, 0, 0};
-
-void CountThing( int16_t type, int16_t flags ) {
-    uint8_t index = 255;
-    thingCat = MONSTER;
-
-    // Monster?
-    switch ( type ) {
-        // Arachnotron
-        case 68: index = 0; break;
-        // Arch-Vile
-        case 64: index = 1; break;
-        // Baron of Hell
-        case 3003: index = 2; break;
-        // Cacodemon
-        case 3005: index = 3; break;
-        // Commander Keen
-        case 72: index = 4; break;
-        // Cyberdemon
-        case 16: index = 5; break;
-        // Demon
-        case 3002: index = 6; break;
-        // Heavy Weapon Dude
-        case 65: index = 7; break;
-        // Hell Knight
-        case 69: index = 8; break;
-        // Imp
-        case 3001: index = 9; break;
-        // Lost Soul
-        case 3006: index = 10; break;
-        // Mancubus
-        case 67: index = 11; break;
-        // Pain Elemental
-        case 71: index = 12; break;
-        // Revenant
-        case 66: index = 13; break;
-        // Shotgun Guy
-        case 9: index = 14; break;
-        // Spectre
-        case 58: index = 15; break;
-        // Spiderdemon
-        case 7: index = 16; break;
-        // Wolfenstein SS
-        case 84: index = 17; break;
-        // Zombieman
-        case 3004: index = 18; break;
-        // Boss brain
-        case 88: index = 19; break;
-        // Not a monster, maybe a powerup?
-        default: thingCat = POWERUP; break;
+uint8_t GetThingKind( int16_t type, thingCat_t* cat, uint8_t* index ) {
+    uint8_t kind = 0;
+
+    if ( type < 0 || type >= NUM_THING_TYPES ) {
+        return 0;
     }
-    // Powerup?
-    if ( thingCat == POWERUP ) {
-        switch ( type ) {
-            // Armor bonus
-            case 2015: index = 0; break;
-            // Backpack
-            case 8: index = 1; break;
-            // Berserk pack
-            case 2023: index = 2; break;
-            // Blue armor
-            case 2019: index = 3; break;
-            // Computer map
-            case 2026: index = 4; break;
-            // Green armor
-            case 2018: index = 5; break;
-            // Health bonus
-            case 2014: index = 6; break;
-            // Invisibility
-            case 2024: index = 7; break;
-            // Invulnerability
-            case 2022: index = 8; break;
-            // Light goggles
-            case 2045: index = 9; break;
-            // Medikit
-            case 2012: index = 10; break;
-            // Megasphere
-            case 83: index = 11; break;
-            // Radiation suit
-            case 2025: index = 12; break;
-            // Soul sphere
-            case 2013: index = 13; break;
-            // Stimpacks
-            case 2011: index = 14; break;
-            // Not a powerup, maybe a weapon?
-            default: thingCat = WEAPON; break;
-        }
+    kind = thingTable[type];
+    if ( kind == 0 ) {
+        return 0;
     }
+    *cat = (thingCat_t)((kind >> 5) - 1);
+    *index = kind & 31;
+    return 1;
+}
+
+void ClearThingCounts( thingcounts_t* counts ) {
+    memset( counts, 0, sizeof(thingcounts_t) );
+}
+
+void CountThing( thingcounts_t* counts, int16_t type, int16_t flags ) {
+    thingCat_t cat = MONSTER;
+    uint8_t index = 0;
+    thingCount_t* count = NULL;
 
-    if ( index != 255 && thingCat == MONSTER ) {
-        if ( flags & TFLAG_SK_EASY )
-            ++monsterCounts[index].easy;
-        if ( flags & TFLAG_SK_NORMAL )
-            ++monsterCounts[index].normal;
-        if ( flags & TFLAG_SK_HARD )
-            ++monsterCounts[index].hard;
-    } else if ( index != 255 && thingCat == POWERUP ) {
-        if ( flags & TFLAG_SK_EASY )
-            ++powerupCounts[index].easy;
-        if ( flags & TFLAG_SK_NORMAL )
-            ++powerupCounts[index].normal;
-        if ( flags & TFLAG_SK_HARD )
-            ++powerupCounts[index].hard;
+    if ( !GetThingKind( type, &cat, &index ) ) {
+        return;
     }
+    count = (flags & TFLAG_MULT) ? &counts->multi[cat][index] : &counts->single[cat][index];
+    if ( flags & TFLAG_SK_EASY )
+        ++count->easy;
+    if ( flags & TFLAG_SK_NORMAL )
+        ++count->normal;
+    if ( flags & TFLAG_SK_HARD )
+        ++count->hard;
 }
 
-void PrintThingCounts( void ) {
-    uint8_t i = 0;
-    // Monsters
-    for ( i = 0; i < 20; ++i ) {
-        if ( !(monsterCounts[i].easy == 0 && monsterCounts[i].normal == 0 &&
-               monsterCounts[i].hard == 0) ) {
-            printf( "%s: %u, %u, %u\n", monsterNames[i], monsterCounts[i].easy,
-                    monsterCounts[i].normal, monsterCounts[i].hard );
+// Add one set of categories to another
+static void MergeCategories( thingCount_t into[NUMTHINGCATS][MAX_CAT_THINGS],
+                             const thingCount_t from[NUMTHINGCATS][MAX_CAT_THINGS] ) {
+    uint32_t c = 0, i = 0;
+
+    for ( c = 0; c < NUMTHINGCATS; ++c ) {
+        for ( i = 0; i < MAX_CAT_THINGS; ++i ) {
+            into[c][i].easy += from[c][i].easy;
+            into[c][i].normal += from[c][i].normal;
+            into[c][i].hard += from[c][i].hard;
         }
     }
-    printf( "\n" );
-    // Powerups
-    for ( i = 0; i < 15; ++i ) {
-        if ( !(powerupCounts[i].easy == 0 && powerupCounts[i].normal == 0 &&
-               powerupCounts[i].hard == 0) ) {
-            printf( "%s: %u, %u, %u\n", powerupNames[i], powerupCounts[i].easy,
-                   powerupCounts[i].normal, powerupCounts[i].hard );
+}
+
+void CountThings( thingcounts_t* counts, const map_t* map ) {
+    uint32_t i = 0;
+
+    for ( i = 0; i < map->numthings; ++i ) {
+        CountThing( counts, map->things[i].type, map->things[i].flags );
+    }
+}
+
+void MergeThingCounts( thingcounts_t* into, const thingcounts_t* from ) {
+    MergeCategories( into->single, from->single );
+    MergeCategories( into->multi, from->multi );
+}
+
+const char* GetThingCatName( thingCat_t cat ) {
+    return catTitles[cat];
+}
+
+const char* GetThingName( thingCat_t cat, uint8_t index ) {
+    return catNames[cat][index];
+}
+
+// Print the counts of one set of categories, each followed by a blank
+// line. Categories with no things are left out if skipEmpty is set, and
+// title is printed before the first thing if there's one.
+static void PrintCategories( const thingCount_t counts[NUMTHINGCATS][MAX_CAT_THINGS],
+                             uint8_t skipEmpty, const char* title ) {
+    uint32_t c = 0, i = 0;
+    uint8_t anyCat = 0;
+
+    for ( c = 0; c < NUMTHINGCATS; ++c ) {
+        uint8_t any = 0;
+        for ( i = 0; catNames[c][i] != NULL; ++i ) {
+            const thingCount_t* count = &counts[c][i];
+            if ( !(count->easy == 0 && count->normal == 0 && count->hard == 0) ) {
+                if ( title != NULL && !anyCat ) {
+                    printf( "%s\n", title );
+                }
+                printf( "%s: %u, %u, %u\n", catNames[c][i], count->easy,
+                        count->normal, count->hard );
+                any = anyCat = 1;
+            }
+        }
+        if ( any || !skipEmpty ) {
+            printf( "\n" );
         }
     }
-    printf( "\n" );
+}
+
+void PrintThingCounts( const thingcounts_t* counts ) {
+    PrintCategories( counts->single, 0, NULL );
+    // Multiplayer only things are only listed if there are any
+    PrintCategories( counts->multi, 1, "Multiplayer only:" );
 }
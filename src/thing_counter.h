@@ -9,7 +9,64 @@
 
 #include "shared.h"
 
-void CountThing( int16_t type, int16_t flags );
-void PrintThingCounts( void );
+// Thing category
+typedef enum {MONSTER, POWERUP, WEAPON, AMMO, KEY, NUMTHINGCATS} thingCat_t;
+
+#define MAX_CAT_THINGS 20 // Most kinds of thing in a category
+
+// Thing counts
+typedef struct {
+    uint32_t easy, normal, hard;
+} thingCount_t;
+
+// Counts of every kind of thing that's counted, with multiplayer only
+// things kept apart
+typedef struct {
+    thingCount_t single[NUMTHINGCATS][MAX_CAT_THINGS];
+    thingCount_t multi[NUMTHINGCATS][MAX_CAT_THINGS];
+} thingcounts_t;
+
+/*
+** Get the category of a thing type and its index within the category.
+** Returns 0 if the type isn't counted.
+*/
+uint8_t GetThingKind( int16_t type, thingCat_t* cat, uint8_t* index );
+
+/*
+** Set all the counts to zero
+*/
+void ClearThingCounts( thingcounts_t* counts );
+
+/*
+** Count one thing
+*/
+void CountThing( thingcounts_t* counts, int16_t type, int16_t flags );
+
+/*
+** Count all of a map's things, adding them to counts
+*/
+void CountThings( thingcounts_t* counts, const map_t* map );
+
+/*
+** Add one set of counts to another, e.g. to total up maps counted on
+** different threads
+*/
+void MergeThingCounts( thingcounts_t* into, const thingcounts_t* from );
+
+/*
+** Get the name of a category, e.g. "monster"
+*/
+const char* GetThingCatName( thingCat_t cat );
+
+/*
+** Get the plural name of a kind of thing, e.g. "Imps". Returns NULL past
+** the last kind in the category.
+*/
+const char* GetThingName( thingCat_t cat, uint8_t index );
+
+/*
+** Print the counts that aren't zero, a category at a time
+*/
+void PrintThingCounts( const thingcounts_t* counts );
 
 #endif
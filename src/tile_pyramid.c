@@ -0,0 +1,274 @@
+/*
+** tile_pyramid.c
+**
+** Exports a map as a z/x/y pyramid of tiles for zoomable map viewers
+*/
+
+#include "tile_pyramid.h"
+#include <errno.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "map_view.h"
+#include "image_writer.h"
+#include "raster.h"
+#include "worker_pool.h"
+#include "trace.h"
+
+// Zoom level whose tiles are handed out to the workers, each drawing that
+// tile and everything below it. The levels above are drawn first.
+#define JOB_ZOOM 3
+
+// Each worker's tile and scratch space
+typedef struct {
+    framebuffer_t fb;
+    uint32_t*     items[PYRAMID_MAX_ZOOM + 1]; // Items on the tile at each zoom level
+    uint32_t      written; // Tiles written
+} pyramidworker_t;
+
+// Everything the tile jobs need
+typedef struct {
+    const displaylist_t*  dl;
+    const drawsettings_t* settings;
+    const char*           outdir;
+    color_t               bgColor;
+    // Items are the lines, then the markers numbered after the lines
+    uint32_t              numItems;
+    float*                bounds;    // Zoom 0 bounding box of each item
+    uint32_t*             rootItems; // Items on the zoom 0 tile, in draw order
+    uint32_t              numRootItems;
+    pyramidworker_t*      workers;
+    uint32_t              maxZoom;
+    uint32_t              jobZoom;   // Zoom level of the tiles in the current jobs
+    uint8_t               recurse;   // Do the jobs draw the levels below too?
+    mapview_t             views[PYRAMID_MAX_ZOOM + 1]; // Each zoom level
+} pyramid_t;
+
+// Make a directory if it isn't there already
+static void MakeDir( const char* path ) {
+    if ( mkdir( path, 0755 ) != 0 && errno != EEXIST ) {
+        fprintf( stderr, "Error creating %s!\n", path );
+    }
+}
+
+// Work out every item's bounding box at zoom 0, and which of them are on
+// the zoom 0 tile at all
+static void BuildBounds( pyramid_t* pyr ) {
+    const displaylist_t* dl = pyr->dl;
+    mapview_t view;
+    uint32_t i = 0;
+
+    MapView_SetupSquare( &view, dl, PYRAMID_TILE_SIZE );
+    MapView_Transform( &view, dl );
+    pyr->numItems = dl->numlines + dl->nummarkers;
+    pyr->bounds = (float*)malloc( sizeof(float) * 4 * (pyr->numItems + 1) );
+    pyr->rootItems = (uint32_t*)malloc( sizeof(uint32_t) * (pyr->numItems + 1) );
+    if ( pyr->bounds == NULL || pyr->rootItems == NULL ) {
+        fprintf( stderr, "Error allocating tile bounds!\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    pyr->numRootItems = 0;
+    for ( i = 0; i < pyr->numItems; ++i ) {
+        float* box = &pyr->bounds[i * 4];
+        if ( i < dl->numlines ) {
+            const dlline_t* line = &dl->lines[i];
+            float x1 = view.verts[line->v1 * 2], y1 = view.verts[line->v1 * 2 + 1];
+            float x2 = view.verts[line->v2 * 2], y2 = view.verts[line->v2 * 2 + 1];
+            box[0] = (x1 < x2) ? x1 : x2;
+            box[1] = (y1 < y2) ? y1 : y2;
+            box[2] = (x1 > x2) ? x1 : x2;
+            box[3] = (y1 > y2) ? y1 : y2;
+        } else {
+            uint32_t m = i - dl->numlines;
+            float radius = dl->markers[m].radius * view.scale;
+            box[0] = view.markers[m * 2] - radius;
+            box[1] = view.markers[m * 2 + 1] - radius;
+            box[2] = view.markers[m * 2] + radius;
+            box[3] = view.markers[m * 2 + 1] + radius;
+        }
+        if ( box[2] >= 0.0f && box[3] >= 0.0f && box[0] < (float)PYRAMID_TILE_SIZE &&
+             box[1] < (float)PYRAMID_TILE_SIZE ) {
+            pyr->rootItems[pyr->numRootItems++] = i;
+        }
+    }
+    MapView_Free( &view );
+}
+
+// Keep the items that might be on a tile, in the order they're drawn. A
+// tile's padded box lies inside its parent's, so the parent's items are
+// all that need checking. Returns how many there are.
+static uint32_t GatherItems( const pyramid_t* pyr, const uint32_t* parentItems,
+                             uint32_t numParentItems, uint32_t* items,
+                             uint32_t zoom, uint32_t x, uint32_t y ) {
+    // Tile size and padding for line width and anti-aliasing, at zoom 0
+    float size = (float)PYRAMID_TILE_SIZE / (1u << zoom);
+    float pad = ((float)pyr->settings->lineWidth + 2.0f) / (1u << zoom);
+    float tile[4];
+    uint32_t i = 0, count = 0;
+
+    tile[0] = x * size - pad;
+    tile[1] = y * size - pad;
+    tile[2] = (x + 1) * size + pad;
+    tile[3] = (y + 1) * size + pad;
+    for ( i = 0; i < numParentItems; ++i ) {
+        const float* box = &pyr->bounds[parentItems[i] * 4];
+        if ( box[0] <= tile[2] && box[2] >= tile[0] &&
+             box[1] <= tile[3] && box[3] >= tile[1] ) {
+            items[count++] = parentItems[i];
+        }
+    }
+    return count;
+}
+
+// Check if a tile was left blank
+static uint8_t TileIsEmpty( const framebuffer_t* fb, color_t bgColor ) {
+    size_t p = 0, numPixels = (size_t)fb->width * fb->height;
+    for ( p = 0; p < numPixels; ++p ) {
+        const uint8_t* px = fb->pixels + p * 4;
+        if ( px[0] != bgColor.r || px[1] != bgColor.g || px[2] != bgColor.b ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Draw and write a tile, then the tiles below it down to the deepest zoom
+// level if recurse is set. Tiles with nothing on them have nothing below
+// them either, so only the parts of the map with something there are
+// visited.
+static void DrawTile( const pyramid_t* pyr, pyramidworker_t* pw, const uint32_t* parentItems,
+                      uint32_t numParentItems, uint32_t zoom, uint32_t x, uint32_t y,
+                      uint8_t recurse ) {
+    const displaylist_t* dl = pyr->dl;
+    const mapview_t* view = &pyr->views[zoom];
+    uint32_t* items = pw->items[zoom];
+    framebuffer_t* fb = &pw->fb;
+    char filename[1024] = "";
+    tracespan_t span;
+    uint32_t count = GatherItems( pyr, parentItems, numParentItems, items, zoom, x, y );
+    uint32_t i = 0;
+    uint8_t ok = 0;
+
+    if ( count == 0 ) {
+        return;
+    }
+    fb->originX = (int32_t)(x * PYRAMID_TILE_SIZE);
+    fb->originY = (int32_t)(y * PYRAMID_TILE_SIZE);
+    FB_Clear( fb, pyr->bgColor );
+    for ( i = 0; i < count; ++i ) {
+        uint32_t item = items[i];
+        if ( item < dl->numlines ) {
+            const dlline_t* line = &dl->lines[item];
+            FB_DrawLine( fb, view->verts[line->v1 * 2], view->verts[line->v1 * 2 + 1],
+                         view->verts[line->v2 * 2], view->verts[line->v2 * 2 + 1],
+                         GetLineStyleColor( (linestyle_t)line->style ),
+                         (float)pyr->settings->lineWidth, pyr->settings->antiAlias );
+        } else {
+            const dlmarker_t* marker = &dl->markers[item - dl->numlines];
+            uint32_t m = item - dl->numlines;
+            float radius = marker->radius * view->scale;
+            FB_FillRect( fb, view->markers[m * 2] - radius, view->markers[m * 2 + 1] - radius,
+                         radius * 2, radius * 2, marker->color );
+        }
+    }
+    if ( !TileIsEmpty( fb, pyr->bgColor ) ) {
+        snprintf( filename, sizeof(filename), "%s/%u/%u", pyr->outdir, zoom, x );
+        MakeDir( filename );
+        snprintf( filename, sizeof(filename), "%s/%u/%u/%u.%s", pyr->outdir, zoom, x, y,
+                  IMG_Extension( (imageformat_t)pyr->settings->imageFormat ) );
+        Trace_Begin( &span, "IMG_Write" );
+        ok = IMG_Write( filename, (imageformat_t)pyr->settings->imageFormat, fb->pixels,
+                        fb->width, fb->height );
+        Trace_End( &span );
+        if ( ok ) {
+            ++pw->written;
+        } else {
+            fprintf( stderr, "Error writing %s!\n", filename );
+        }
+    }
+
+    if ( recurse && zoom < pyr->maxZoom ) {
+        DrawTile( pyr, pw, items, count, zoom + 1, x * 2, y * 2, 1 );
+        DrawTile( pyr, pw, items, count, zoom + 1, x * 2 + 1, y * 2, 1 );
+        DrawTile( pyr, pw, items, count, zoom + 1, x * 2, y * 2 + 1, 1 );
+        DrawTile( pyr, pw, items, count, zoom + 1, x * 2 + 1, y * 2 + 1, 1 );
+    }
+}
+
+// Draw one tile of the job zoom level, starting from the zoom 0 items
+static void DrawTileJob( uint32_t job, uint32_t worker, void* data ) {
+    const pyramid_t* pyr = (const pyramid_t*)data;
+    uint32_t tilesAcross = 1u << pyr->jobZoom;
+
+    DrawTile( pyr, &pyr->workers[worker], pyr->rootItems, pyr->numRootItems,
+              pyr->jobZoom, job % tilesAcross, job / tilesAcross, pyr->recurse );
+}
+
+/*
+** Draw a map to a z/x/y tile pyramid
+*/
+uint32_t ExportMapTiles( const displaylist_t* dl, const drawsettings_t* settings,
+                         const char* outdir ) {
+    pyramid_t pyr;
+    char dirname[1024] = "";
+    color_t bgColor = {255, 255, 255};
+    uint32_t numWorkers = GetNumWorkers( settings->renderThreads );
+    uint32_t w = 0, z = 0, written = 0;
+
+    memset( &pyr, 0, sizeof(pyr) );
+    pyr.dl = dl;
+    pyr.settings = settings;
+    pyr.outdir = outdir;
+    pyr.bgColor = bgColor;
+    pyr.maxZoom = (settings->maxZoom > PYRAMID_MAX_ZOOM) ? PYRAMID_MAX_ZOOM : settings->maxZoom;
+
+    BuildBounds( &pyr );
+
+    pyr.workers = (pyramidworker_t*)calloc( numWorkers, sizeof(pyramidworker_t) );
+    if ( pyr.workers == NULL ) {
+        fprintf( stderr, "Error allocating tile workers!\n" );
+        exit( EXIT_FAILURE );
+    }
+    for ( w = 0; w < numWorkers; ++w ) {
+        FB_Init( &pyr.workers[w].fb, PYRAMID_TILE_SIZE, PYRAMID_TILE_SIZE, bgColor );
+        for ( z = 0; z <= pyr.maxZoom; ++z ) {
+            pyr.workers[w].items[z] = (uint32_t*)malloc( sizeof(uint32_t) * (pyr.numRootItems + 1) );
+            if ( pyr.workers[w].items[z] == NULL ) {
+                fprintf( stderr, "Error allocating tile workers!\n" );
+                exit( EXIT_FAILURE );
+            }
+        }
+    }
+
+    MakeDir( outdir );
+    for ( z = 0; z <= pyr.maxZoom; ++z ) {
+        snprintf( dirname, sizeof(dirname), "%s/%u", outdir, z );
+        MakeDir( dirname );
+        MapView_SetupSquare( &pyr.views[z], dl, PYRAMID_TILE_SIZE << z );
+        MapView_Transform( &pyr.views[z], dl );
+    }
+
+    // The few tiles above the job zoom level one at a time, then a job for
+    // each tile of the job level and all the tiles below it
+    for ( pyr.jobZoom = 0; pyr.jobZoom < JOB_ZOOM && pyr.jobZoom < pyr.maxZoom; ++pyr.jobZoom ) {
+        RunJobs( 1u << (pyr.jobZoom * 2), numWorkers, DrawTileJob, &pyr );
+    }
+    pyr.recurse = 1;
+    RunJobs( 1u << (pyr.jobZoom * 2), numWorkers, DrawTileJob, &pyr );
+
+    // Cleanup
+    for ( w = 0; w < numWorkers; ++w ) {
+        written += pyr.workers[w].written;
+        FB_Free( &pyr.workers[w].fb );
+        for ( z = 0; z <= pyr.maxZoom; ++z ) {
+            free( pyr.workers[w].items[z] );
+        }
+    }
+    for ( z = 0; z <= pyr.maxZoom; ++z ) {
+        MapView_Free( &pyr.views[z] );
+    }
+    free( pyr.workers );
+    free( pyr.rootItems );
+    free( pyr.bounds );
+    return written;
+}
@@ -0,0 +1,24 @@
+/*
+** tile_pyramid.h
+**
+** Exports a map as a z/x/y pyramid of tiles for zoomable map viewers
+*/
+
+#ifndef __TILE_PYRAMID_H
+#define __TILE_PYRAMID_H
+
+#include "shared.h"
+#include "map_drawer.h"
+
+#define PYRAMID_TILE_SIZE 256 // Width and height of every tile
+#define PYRAMID_MAX_ZOOM  12  // Deepest zoom level allowed
+
+/*
+** Draw a display list to outdir/z/x/y.<ext> for zoom levels 0 to settings->maxZoom.
+** Zoom level z is 2^z tiles across. Tiles with nothing on them aren't
+** written. Returns the number of tiles written.
+*/
+uint32_t ExportMapTiles( const displaylist_t* dl, const drawsettings_t* settings,
+                         const char* outdir );
+
+#endif
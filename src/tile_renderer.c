@@ -0,0 +1,304 @@
+/*
+** tile_renderer.c
+**
+** Draws a map with the software rasterizer a tile at a time
+*/
+
+#include "tile_renderer.h"
+#include <math.h>
+#include <pthread.h>
+#include "image_writer.h"
+#include "raster.h"
+#include "worker_pool.h"
+#include "phase_stats.h"
+#include "trace.h"
+
+// Most bytes of tiles held at once. Tiles are made shorter for images
+// too wide for two of them to fit.
+#define TILE_BUDGET (32u << 20)
+
+// Everything the tile jobs need
+typedef struct {
+    const displaylist_t*  dl;
+    const drawsettings_t* settings;
+    const mapview_t*      view;
+    color_t               bgColor;
+    uint32_t              tileHeight;
+    uint32_t              numTiles;
+    const uint32_t*       binStarts; // Where each tile's lines start in binLines
+    const uint32_t*       binLines;  // Line numbers touching each tile
+    imagestream_t*        is;
+    statsrecord_t*        record;    // Where writing the tiles is counted
+    // Tiles are drawn into a ring of framebuffers, two groups of them, so
+    // one group can be written out while the next is drawn. Tile t goes in
+    // slot t % numSlots once tile t - numSlots has been written.
+    framebuffer_t*        slots;
+    uint8_t*              drawn;     // Is each slot waiting to be written?
+    uint32_t              numSlots;
+    uint32_t              nextWrite; // Next tile to write
+    uint8_t               writing;   // Is a worker writing tiles?
+    uint8_t               ok;        // Cleared if a write fails
+    pthread_mutex_t       lock;      // Guards the ring
+    pthread_cond_t        written;   // Signalled when a tile is written
+} tilebatch_t;
+
+// Get the tiles a line touches, allowing for its width and anti-aliasing.
+// Returns 0 if it's outside the image.
+static uint8_t LineTiles( const tilebatch_t* batch, const dlline_t* line,
+                          uint32_t* first, uint32_t* last ) {
+    const float* verts = batch->view->verts;
+    float y1 = verts[line->v1 * 2 + 1], y2 = verts[line->v2 * 2 + 1];
+    float pad = (float)batch->settings->lineWidth + 2.0f;
+    float top = ((y1 < y2) ? y1 : y2) - pad, bottom = ((y1 > y2) ? y1 : y2) + pad;
+
+    if ( bottom < 0.0f || top >= (float)batch->view->height ) {
+        return 0;
+    }
+    if ( bottom >= (float)batch->view->height ) {
+        bottom = (float)(batch->view->height - 1);
+    }
+    *first = (top < 0.0f) ? 0 : (uint32_t)top / batch->tileHeight;
+    *last = (uint32_t)bottom / batch->tileHeight;
+    return 1;
+}
+
+// Sort the lines into bins by the tiles they touch. A line crossing
+// several tiles goes in each of their bins.
+static void BinLines( tilebatch_t* batch, uint32_t** binStarts, uint32_t** binLines ) {
+    const displaylist_t* dl = batch->dl;
+    uint32_t* starts = (uint32_t*)calloc( batch->numTiles + 1, sizeof(uint32_t) );
+    uint32_t* lines = NULL;
+    uint32_t i = 0, t = 0, first = 0, last = 0;
+
+    if ( starts == NULL ) {
+        fprintf( stderr, "Error allocating tile bins!\n" );
+        exit( EXIT_FAILURE );
+    }
+    // Count the lines in each bin
+    for ( i = 0; i < dl->numlines; ++i ) {
+        if ( LineTiles( batch, &dl->lines[i], &first, &last ) ) {
+            for ( t = first; t <= last; ++t ) {
+                ++starts[t + 1];
+            }
+        }
+    }
+    for ( t = 1; t <= batch->numTiles; ++t ) {
+        starts[t] += starts[t - 1];
+    }
+    lines = (uint32_t*)malloc( sizeof(uint32_t) * (starts[batch->numTiles] + 1) );
+    if ( lines == NULL ) {
+        fprintf( stderr, "Error allocating tile bins!\n" );
+        exit( EXIT_FAILURE );
+    }
+    // Fill the bins, keeping the lines in order so they overlap the same
+    // way they would in one big image. starts[t] is moved along to the end
+    // of each bin and then put back.
+    for ( i = 0; i < dl->numlines; ++i ) {
+        if ( LineTiles( batch, &dl->lines[i], &first, &last ) ) {
+            for ( t = first; t <= last; ++t ) {
+                lines[starts[t]++] = i;
+            }
+        }
+    }
+    for ( t = batch->numTiles; t > 0; --t ) {
+        starts[t] = starts[t - 1];
+    }
+    starts[0] = 0;
+    *binStarts = starts;
+    *binLines = lines;
+}
+
+// Draw one tile into a framebuffer
+static void DrawTile( const tilebatch_t* batch, uint32_t tile, framebuffer_t* fb ) {
+    const displaylist_t* dl = batch->dl;
+    const float* verts = batch->view->verts;
+    float lineWidth = (float)batch->settings->lineWidth;
+    uint32_t i = 0;
+    tracespan_t span;
+
+    fb->originY = (int32_t)(tile * batch->tileHeight);
+    fb->height = batch->view->height - tile * batch->tileHeight;
+    if ( fb->height > batch->tileHeight ) {
+        fb->height = batch->tileHeight;
+    }
+    FB_Clear( fb, batch->bgColor );
+
+    Trace_Begin( &span, "DrawTileJob linedefs" );
+    for ( i = batch->binStarts[tile]; i < batch->binStarts[tile + 1]; ++i ) {
+        const dlline_t* line = &dl->lines[batch->binLines[i]];
+        FB_DrawLine( fb, verts[line->v1 * 2], verts[line->v1 * 2 + 1],
+                     verts[line->v2 * 2], verts[line->v2 * 2 + 1],
+                     GetLineStyleColor( (linestyle_t)line->style ), lineWidth,
+                     batch->settings->antiAlias );
+    }
+    Trace_End( &span );
+    Trace_Begin( &span, "DrawTileJob things" );
+    for ( i = 0; i < dl->nummarkers; ++i ) {
+        float radius = dl->markers[i].radius * batch->view->scale;
+        float y = batch->view->markers[i * 2 + 1];
+        // FB_FillRect clips too, this just skips far away markers quickly
+        if ( y + radius + 1.0f < (float)fb->originY ||
+             y - radius - 1.0f > (float)(fb->originY + (int32_t)fb->height) ) {
+            continue;
+        }
+        FB_FillRect( fb, batch->view->markers[i * 2] - radius, y - radius,
+                     radius * 2, radius * 2, dl->markers[i].color );
+    }
+    Trace_End( &span );
+}
+
+// Write out the drawn tiles that are next in order, unless another worker
+// already is. Called with the lock held.
+static void WriteDrawnTiles( tilebatch_t* batch ) {
+    statsrecord_t* prevRecord = NULL;
+    phasetimer_t encode;
+    tracespan_t span;
+
+    if ( batch->writing ) {
+        return;
+    }
+    batch->writing = 1;
+    while ( batch->nextWrite < batch->numTiles && batch->drawn[batch->nextWrite % batch->numSlots] ) {
+        framebuffer_t* fb = &batch->slots[batch->nextWrite % batch->numSlots];
+        uint8_t ok = batch->ok;
+        // Only one worker writes at a time, so it can count in the record
+        // of the thread drawing the image
+        pthread_mutex_unlock( &batch->lock );
+        prevRecord = Stats_SetRecord( batch->record );
+        Stats_Begin( &encode, PHASE_ENCODE );
+        Trace_Begin( &span, "IMG_WriteRows" );
+        if ( ok ) {
+            ok = IMG_WriteRows( batch->is, fb->pixels, fb->height );
+        }
+        Trace_End( &span );
+        Stats_End( &encode );
+        Stats_SetRecord( prevRecord );
+        pthread_mutex_lock( &batch->lock );
+        batch->ok = ok;
+        batch->drawn[batch->nextWrite % batch->numSlots] = 0;
+        ++batch->nextWrite;
+        pthread_cond_broadcast( &batch->written );
+    }
+    batch->writing = 0;
+}
+
+// Draw one tile once its slot is free, then write out whatever is ready
+static void DrawTileJob( uint32_t job, uint32_t worker, void* data ) {
+    tilebatch_t* batch = (tilebatch_t*)data;
+    uint8_t ok = 0;
+
+    (void)worker;
+    pthread_mutex_lock( &batch->lock );
+    while ( job >= batch->nextWrite + batch->numSlots ) {
+        pthread_cond_wait( &batch->written, &batch->lock );
+    }
+    ok = batch->ok;
+    pthread_mutex_unlock( &batch->lock );
+
+    // Nothing more gets written after a failure, so don't bother drawing
+    if ( ok ) {
+        DrawTile( batch, job, &batch->slots[job % batch->numSlots] );
+    }
+
+    pthread_mutex_lock( &batch->lock );
+    batch->drawn[job % batch->numSlots] = 1;
+    WriteDrawnTiles( batch );
+    pthread_mutex_unlock( &batch->lock );
+}
+
+/*
+** Draw a map to an image a tile at a time
+*/
+uint8_t DrawMapTiles( const displaylist_t* dl, const drawsettings_t* settings,
+                      const mapview_t* view, color_t bgColor, const outsink_t* sink ) {
+    tilebatch_t batch;
+    phasetimer_t encode;
+    tracespan_t span;
+    uint32_t* binStarts = NULL;
+    uint32_t* binLines = NULL;
+    uint32_t numWorkers = GetNumWorkers( settings->renderThreads );
+    uint32_t t = 0, groupSize = 0, rowBytes = 0;
+    uint8_t ok = 1;
+
+    if ( view->width == 0 || view->height == 0 ) {
+        return 0;
+    }
+    memset( &batch, 0, sizeof(batch) );
+    batch.is = IMG_BeginSink( sink, (imageformat_t)settings->imageFormat,
+                              view->width, view->height );
+    if ( batch.is == NULL ) {
+        return 0;
+    }
+
+    batch.dl = dl;
+    batch.settings = settings;
+    batch.view = view;
+    batch.bgColor = bgColor;
+    // Both groups of tiles have to fit in the budget, and so do at least
+    // two tiles however wide the image is
+    rowBytes = view->width * 4;
+    batch.tileHeight = (settings->tileHeight > 0) ? settings->tileHeight : 1;
+    if ( batch.tileHeight > TILE_BUDGET / 2 / rowBytes ) {
+        batch.tileHeight = TILE_BUDGET / 2 / rowBytes;
+    }
+    if ( batch.tileHeight < 1 ) {
+        batch.tileHeight = 1;
+    }
+    if ( batch.tileHeight > view->height ) {
+        batch.tileHeight = view->height;
+    }
+    batch.numTiles = (view->height + batch.tileHeight - 1) / batch.tileHeight;
+
+    BinLines( &batch, &binStarts, &binLines );
+    batch.binStarts = binStarts;
+    batch.binLines = binLines;
+
+    // A group is a tile per worker, as many as the budget has room for
+    groupSize = TILE_BUDGET / 2 / (rowBytes * batch.tileHeight);
+    if ( groupSize > numWorkers ) {
+        groupSize = numWorkers;
+    }
+    if ( groupSize < 1 ) {
+        groupSize = 1;
+    }
+    batch.numSlots = groupSize * 2;
+    if ( batch.numSlots > batch.numTiles ) {
+        batch.numSlots = batch.numTiles;
+    }
+    batch.slots = (framebuffer_t*)malloc( sizeof(framebuffer_t) * batch.numSlots );
+    batch.drawn = (uint8_t*)calloc( batch.numSlots, sizeof(uint8_t) );
+    if ( batch.slots == NULL || batch.drawn == NULL ) {
+        fprintf( stderr, "Error allocating tiles!\n" );
+        exit( EXIT_FAILURE );
+    }
+    for ( t = 0; t < batch.numSlots; ++t ) {
+        FB_Init( &batch.slots[t], view->width, batch.tileHeight, bgColor );
+    }
+    batch.ok = 1;
+    batch.record = Stats_GetRecord();
+    pthread_mutex_init( &batch.lock, NULL );
+    pthread_cond_init( &batch.written, NULL );
+
+    // Workers past the number of slots would only wait for one
+    RunJobs( batch.numTiles, (numWorkers < batch.numSlots) ? numWorkers : batch.numSlots,
+             DrawTileJob, &batch );
+    ok = batch.ok;
+
+    // Cleanup
+    pthread_cond_destroy( &batch.written );
+    pthread_mutex_destroy( &batch.lock );
+    for ( t = 0; t < batch.numSlots; ++t ) {
+        batch.slots[t].height = batch.tileHeight;
+        FB_Free( &batch.slots[t] );
+    }
+    free( batch.drawn );
+    free( batch.slots );
+    free( binLines );
+    free( binStarts );
+    Stats_Begin( &encode, PHASE_ENCODE );
+    Trace_Begin( &span, "IMG_End" );
+    ok = IMG_End( batch.is ) && ok;
+    Trace_End( &span );
+    Stats_End( &encode );
+    return ok;
+}
@@ -0,0 +1,25 @@
+/*
+** tile_renderer.h
+**
+** Draws a map with the software rasterizer a tile at a time
+*/
+
+#ifndef __TILE_RENDERER_H
+#define __TILE_RENDERER_H
+
+#include "shared.h"
+#include "map_drawer.h"
+#include "map_view.h"
+#include "out_sink.h"
+
+/*
+** Draw a display list to an image written to a sink. The image is split
+** into tiles the full width of the image which are drawn on a pool of
+** threads and written out in order while the next ones are drawn. The
+** tiles in memory are kept to a fixed budget however many threads there
+** are. Returns 0 if the image couldn't be written.
+*/
+uint8_t DrawMapTiles( const displaylist_t* dl, const drawsettings_t* settings,
+                      const mapview_t* view, color_t bgColor, const outsink_t* sink );
+
+#endif
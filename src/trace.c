@@ -0,0 +1,269 @@
+/*
+** trace.c
+**
+** Spans of work on each thread, written out as a Chrome trace event file
+** that can be loaded in chrome://tracing or Perfetto
+*/
+
+#include "trace.h"
+#include "buf_writer.h"
+#include <time.h>
+
+#define TRACE_BLOCK_EVENTS 1024
+// Most blocks recorded across all threads, 128 MB of spans. Spans past
+// that are dropped and counted.
+#define TRACE_MAX_BLOCKS   4096
+
+// A finished span
+typedef struct {
+    const char* name;
+    char        map[8]; // Map being worked on, empty for none
+    uint64_t    start, dur; // Nanoseconds
+} traceevent_t;
+
+// Spans are kept in blocks so recording never has to copy them
+typedef struct traceblock_s {
+    struct traceblock_s* next;
+    uint32_t     numEvents;
+    traceevent_t events[TRACE_BLOCK_EVENTS];
+} traceblock_t;
+
+// Everything one thread recorded. Only that thread ever writes to it, and
+// it's only read once the thread is done, so it's never locked.
+typedef struct tracethread_s {
+    struct tracethread_s* next; // Next thread in the list of them all
+    uint32_t      id;     // Unique to the thread, 0 for the one that opened the trace
+    uint32_t      worker; // Worker number it was last given, for its name
+    traceblock_t* first;
+    traceblock_t* last;
+} tracethread_t;
+
+static char* traceFile = NULL;
+static uint64_t traceStart = 0;
+// Pushed to without a lock as threads record their first span
+static tracethread_t* traceThreads = NULL;
+static uint32_t nextThreadId = 1; // Handed out to threads as they first record
+static uint32_t numBlocks = 0;
+static uint32_t droppedSpans = 0;
+
+static __thread tracethread_t* thisThread = NULL;
+static __thread uint32_t thisWorker = 0;
+static __thread uint8_t isOpener = 0; // Did this thread open the trace?
+static __thread char thisMap[8] = "";
+
+static uint64_t Now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec - traceStart;
+}
+
+/*
+** Start tracing
+*/
+void Trace_Open( const char* filename ) {
+    traceFile = strdup( filename );
+    if ( traceFile == NULL ) {
+        fprintf( stderr, "Error allocating trace!\n" );
+        exit( EXIT_FAILURE );
+    }
+    traceStart = 0;
+    traceStart = Now();
+    nextThreadId = 1;
+    numBlocks = 0;
+    droppedSpans = 0;
+    isOpener = 1;
+}
+
+uint8_t Trace_Enabled( void ) {
+    return traceFile != NULL;
+}
+
+void Trace_SetThread( uint32_t worker ) {
+    thisWorker = worker;
+    if ( thisThread != NULL ) {
+        thisThread->worker = worker;
+    }
+}
+
+void Trace_SetMap( const char* name ) {
+    uint32_t c = 0;
+
+    // Lump names fill all 8 characters without a NUL
+    memset( thisMap, 0, sizeof(thisMap) );
+    for ( c = 0; name != NULL && c < sizeof(thisMap) && name[c] != '\0'; ++c ) {
+        thisMap[c] = name[c];
+    }
+}
+
+const char* Trace_GetMap( void ) {
+    return thisMap;
+}
+
+void Trace_Begin( tracespan_t* span, const char* name ) {
+    span->name = NULL;
+    if ( traceFile == NULL ) {
+        return;
+    }
+    span->name = name;
+    span->start = Now();
+}
+
+// Get a new block for the calling thread's spans, adding the thread to the
+// list first if this is its first one. Returns NULL if out of memory or the
+// trace is full.
+static traceblock_t* NewBlock( void ) {
+    traceblock_t* block = NULL;
+
+    if ( __atomic_fetch_add( &numBlocks, 1, __ATOMIC_RELAXED ) >= TRACE_MAX_BLOCKS ) {
+        return NULL;
+    }
+    block = (traceblock_t*)malloc( sizeof(traceblock_t) );
+    if ( block == NULL ) {
+        return NULL;
+    }
+    block->next = NULL;
+    block->numEvents = 0;
+    if ( thisThread == NULL ) {
+        thisThread = (tracethread_t*)malloc( sizeof(tracethread_t) );
+        if ( thisThread == NULL ) {
+            free( block );
+            return NULL;
+        }
+        // Threads from different pools can share a worker number, so each
+        // gets its own ID to keep its spans on its own row
+        thisThread->id = isOpener ? 0 : __atomic_fetch_add( &nextThreadId, 1, __ATOMIC_RELAXED );
+        thisThread->worker = thisWorker;
+        thisThread->first = block;
+        thisThread->next = __atomic_load_n( &traceThreads, __ATOMIC_RELAXED );
+        while ( !__atomic_compare_exchange_n( &traceThreads, &thisThread->next, thisThread,
+                                               1, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) ) {
+        }
+    } else {
+        thisThread->last->next = block;
+    }
+    thisThread->last = block;
+    return block;
+}
+
+void Trace_End( tracespan_t* span ) {
+    traceblock_t* block = NULL;
+    traceevent_t* ev = NULL;
+    uint64_t end = 0;
+
+    if ( span->name == NULL ) {
+        return;
+    }
+    end = Now();
+    block = (thisThread != NULL) ? thisThread->last : NULL;
+    if ( block == NULL || block->numEvents == TRACE_BLOCK_EVENTS ) {
+        block = NewBlock();
+        if ( block == NULL ) {
+            __atomic_fetch_add( &droppedSpans, 1, __ATOMIC_RELAXED );
+            return;
+        }
+    }
+    ev = &block->events[block->numEvents++];
+    ev->name = span->name;
+    memcpy( ev->map, thisMap, sizeof(ev->map) );
+    ev->start = span->start;
+    ev->dur = end - span->start;
+}
+
+// Write a name as a JSON string. Lump names can hold any bytes, so only
+// printable ones are kept.
+static void PutName( bufwriter_t* bw, const char* name, size_t maxLen ) {
+    size_t i = 0;
+
+    BW_PutChar( bw, '"' );
+    for ( i = 0; i < maxLen && name[i] != '\0'; ++i ) {
+        char c = name[i];
+        if ( c < ' ' || c > '~' ) {
+            continue;
+        }
+        if ( c == '"' || c == '\\' ) {
+            BW_PutChar( bw, '\\' );
+        }
+        BW_PutChar( bw, c );
+    }
+    BW_PutChar( bw, '"' );
+}
+
+/*
+** Write the trace out and free it
+*/
+uint8_t Trace_Close( void ) {
+    tracethread_t* thread = NULL;
+    bufwriter_t* bw = NULL;
+    uint8_t first = 1;
+
+    if ( traceFile == NULL ) {
+        return 1;
+    }
+    bw = BW_Open( traceFile );
+    if ( bw == NULL ) {
+        fprintf( stderr, "Error opening %s for writing!\n", traceFile );
+    } else {
+        BW_PutStr( bw, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+    }
+
+    thread = __atomic_load_n( &traceThreads, __ATOMIC_ACQUIRE );
+    while ( thread != NULL ) {
+        tracethread_t* next = thread->next;
+        traceblock_t* block = thread->first;
+        uint32_t e = 0;
+
+        if ( bw != NULL ) {
+            // Name each thread's row, the same name may come more than once
+            BW_PutStr( bw, first ? "" : ",\n" );
+            BW_PutStr( bw, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" );
+            BW_PutInt( bw, thread->id );
+            BW_PutStr( bw, ",\"args\":{\"name\":\"" );
+            BW_PutStr( bw, (thread->id == 0) ? "main" : "worker " );
+            if ( thread->id != 0 ) {
+                BW_PutInt( bw, thread->worker );
+            }
+            BW_PutStr( bw, "\"}}" );
+            first = 0;
+        }
+        while ( block != NULL ) {
+            traceblock_t* nextBlock = block->next;
+            for ( e = 0; bw != NULL && e < block->numEvents; ++e ) {
+                const traceevent_t* ev = &block->events[e];
+                BW_PutStr( bw, ",\n{\"name\":" );
+                PutName( bw, ev->name, SIZE_MAX );
+                BW_PutStr( bw, ",\"ph\":\"X\",\"pid\":1,\"tid\":" );
+                BW_PutInt( bw, thread->id );
+                BW_PutStr( bw, ",\"ts\":" );
+                BW_PutFixed( bw, ev->start / 1000.0, 3 );
+                BW_PutStr( bw, ",\"dur\":" );
+                BW_PutFixed( bw, ev->dur / 1000.0, 3 );
+                if ( ev->map[0] != '\0' ) {
+                    BW_PutStr( bw, ",\"args\":{\"map\":" );
+                    PutName( bw, ev->map, sizeof(ev->map) );
+                    BW_PutChar( bw, '}' );
+                }
+                BW_PutChar( bw, '}' );
+            }
+            free( block );
+            block = nextBlock;
+        }
+        free( thread );
+        thread = next;
+    }
+    traceThreads = NULL;
+    thisThread = NULL;
+    if ( droppedSpans > 0 ) {
+        fprintf( stderr, "Warning: the trace was full, %u spans were left out.\n", droppedSpans );
+    }
+
+    if ( bw != NULL ) {
+        BW_PutStr( bw, "\n]}\n" );
+        if ( !BW_Close( bw ) ) {
+            fprintf( stderr, "Error writing %s!\n", traceFile );
+            bw = NULL;
+        }
+    }
+    free( traceFile );
+    traceFile = NULL;
+    return bw != NULL;
+}
@@ -0,0 +1,67 @@
+/*
+** trace.h
+**
+** Spans of work on each thread, written out as a Chrome trace event file
+** that can be loaded in chrome://tracing or Perfetto
+*/
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include "shared.h"
+
+// A span being recorded
+typedef struct {
+    const char* name;  // What it is, NULL if tracing is off
+    uint64_t    start; // Nanoseconds since the trace was started
+} tracespan_t;
+
+/*
+** Start tracing, to be written to filename by Trace_Close. Must be called
+** before any other threads are started. At most about 4 million spans are
+** kept, any after that are dropped with a warning when the trace is
+** written.
+*/
+void Trace_Open( const char* filename );
+
+/*
+** Is a trace being recorded?
+*/
+uint8_t Trace_Enabled( void );
+
+/*
+** Set the worker number the calling thread's row is named after. Every
+** thread still gets its own row, with the thread that opened the trace
+** as 0 and the others numbered as they first record a span.
+*/
+void Trace_SetThread( uint32_t worker );
+
+/*
+** Tag the calling thread's spans with a map name, NULL for none
+*/
+void Trace_SetMap( const char* name );
+
+/*
+** Get the calling thread's map name, which stays valid until it's changed.
+** Lets worker threads tag their spans with the map they're working for.
+*/
+const char* Trace_GetMap( void );
+
+/*
+** Start a span on the calling thread. The name must be a string that
+** lasts until the trace is written.
+*/
+void Trace_Begin( tracespan_t* span, const char* name );
+
+/*
+** Finish a span and record it
+*/
+void Trace_End( tracespan_t* span );
+
+/*
+** Write the trace out and free it. Every other thread that recorded spans
+** must have finished. Returns 0 if it couldn't be written.
+*/
+uint8_t Trace_Close( void );
+
+#endif
@@ -0,0 +1,286 @@
+/*
+** wad_dir.c
+**
+** Loading a WAD's lump directory and everything derived from it, with an
+** optional cache file so repeat runs can skip the work
+*/
+
+#include "wad_dir.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_ID      "WSDC"
+#define CACHE_VERSION 2
+#define CACHE_ENDIAN  0x01020304 // Reads differently on the wrong byte order
+
+// Cache file header. The arrays follow it, each starting on an 8 byte
+// boundary so they can be used straight from the mapped file.
+typedef struct {
+    char      id[4];     // CACHE_ID
+    uint32_t  version;   // CACHE_VERSION
+    uint32_t  endian;    // CACHE_ENDIAN
+    uint32_t  numslots;  // Size of the lump index hash table
+    uint64_t  filesize;  // Size of the WAD file
+    int64_t   mtime;     // Modification time of the WAD file
+    uint64_t  hash;      // Hash of the WAD header and directory
+    wadinfo_t info;      // WAD header
+    uint32_t  numMaps;   // Number of maps
+    uint32_t  palLump;   // Lump number of the palette
+    uint32_t  pad;
+    uint64_t  slotsOfs;  // Offset to lump index hash table
+    uint64_t  lumpsOfs;  // Offset to lump directory
+    uint64_t  nextOfs;   // Offset to lump index chains
+    uint64_t  mapsOfs;   // Offset to map blocks
+} cacheheader_t;
+
+// Round up to the next multiple of 8
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+// Hash the WAD header and the raw lump directory
+static uint64_t HashDirectory( wad_handle_t* wad, const wadinfo_t* info ) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    uint64_t pos = info->infotableofs;
+    uint64_t left = (uint64_t)info->numlumps * sizeof(lumpinfo_t);
+    uint64_t words[1024]; // Directory is hashed 8 KB at a time
+    uint32_t w = 0;
+
+    words[1] = 0; // Header is only 12 bytes
+    memcpy( words, info, sizeof(wadinfo_t) );
+    hash = (hash ^ words[0]) * 0x100000001B3ULL;
+    hash = (hash ^ words[1]) * 0x100000001B3ULL;
+    while ( left > 0 ) {
+        uint32_t size = (left < sizeof(words)) ? (uint32_t)left : sizeof(words);
+        WAD_ReadRaw( wad, words, pos, size );
+        // Entries are 16 bytes so the size is always a whole number of words
+        for ( w = 0; w < size / 8; ++w ) {
+            hash = (hash ^ words[w]) * 0x100000001B3ULL;
+        }
+        pos += size;
+        left -= size;
+    }
+    return hash;
+}
+
+// Is a lump number in the cache either LUMP_NONE or a real lump?
+#define VALID_LUMP(l, numlumps) ((l) == LUMP_NONE || (l) < (numlumps))
+
+// Is an array of count items of size bytes at an offset inside the file?
+static uint8_t InFile( uint64_t ofs, uint64_t count, uint64_t size, uint64_t filesize ) {
+    return (ofs & 7) == 0 && ofs <= filesize && count <= (filesize - ofs) / size;
+}
+
+// Check the arrays are all inside a mapped cache file, every lump number in
+// them is in range and the hash table is one the index can probe, so a
+// stale or damaged cache can't send lookups outside the arrays
+static uint8_t CheckCache( const cacheheader_t* header, const uint8_t* base,
+                           uint64_t filesize ) {
+    const uint32_t* slots = (const uint32_t*)(base + header->slotsOfs);
+    const uint32_t* next = (const uint32_t*)(base + header->nextOfs);
+    const mapblock_t* maps = (const mapblock_t*)(base + header->mapsOfs);
+    uint32_t numlumps = header->info.numlumps;
+    uint32_t i = 0, m = 0, used = 0;
+
+    if ( !InFile( header->slotsOfs, header->numslots, sizeof(uint32_t), filesize ) ||
+         !InFile( header->lumpsOfs, numlumps, sizeof(lumpinfo_t), filesize ) ||
+         !InFile( header->nextOfs, numlumps, sizeof(uint32_t), filesize ) ||
+         !InFile( header->mapsOfs, header->numMaps, sizeof(mapblock_t), filesize ) ) {
+        return 0;
+    }
+    // A power of two with room for every lump and at least one empty slot,
+    // and no smaller than WAD_BuildLumpIndex makes it
+    if ( header->numslots < LUMP_MIN_SLOTS || (header->numslots & (header->numslots - 1)) != 0 ||
+         header->numslots < (uint64_t)numlumps * 2 ||
+         !VALID_LUMP( header->palLump, numlumps ) ) {
+        return 0;
+    }
+    for ( i = 0; i < header->numslots; ++i ) {
+        if ( slots[i] != LUMP_NONE ) {
+            if ( slots[i] >= numlumps ) {
+                return 0;
+            }
+            ++used;
+        }
+    }
+    if ( used > numlumps ) {
+        return 0;
+    }
+    for ( i = 0; i < numlumps; ++i ) {
+        if ( next[i] >= numlumps ) {
+            return 0;
+        }
+    }
+    for ( m = 0; m < header->numMaps; ++m ) {
+        if ( maps[m].marker >= numlumps ) {
+            return 0;
+        }
+        for ( i = 0; i < ML_NUMLUMPS; ++i ) {
+            if ( !VALID_LUMP( maps[m].lumps[i], numlumps ) ) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Use the cache file if it's there and matches the WAD
+static uint8_t LoadCache( wad_handle_t* wad, const char* cachefile,
+                          const struct stat* wadst, waddir_t* dir ) {
+    struct stat st;
+    const cacheheader_t* header = NULL;
+    const uint8_t* base = NULL;
+    wadinfo_t info;
+    void* view = NULL;
+    int fd = open( cachefile, O_RDONLY );
+
+    if ( fd < 0 ) {
+        return 0;
+    }
+    if ( fstat( fd, &st ) != 0 || (size_t)st.st_size < sizeof(cacheheader_t) ) {
+        close( fd );
+        return 0;
+    }
+    view = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( view == MAP_FAILED ) {
+        return 0;
+    }
+    base = (const uint8_t*)view;
+    header = (const cacheheader_t*)view;
+
+    // Check it's a cache of this exact WAD
+    WAD_ReadHeader( wad, &info );
+    if ( memcmp( header->id, CACHE_ID, 4 ) || header->version != CACHE_VERSION ||
+         header->endian != CACHE_ENDIAN ||
+         header->filesize != (uint64_t)wadst->st_size ||
+         header->mtime != (int64_t)wadst->st_mtime ||
+         memcmp( &header->info, &info, sizeof(wadinfo_t) ) ||
+         header->hash != HashDirectory( wad, &info ) ||
+         !CheckCache( header, base, (uint64_t)st.st_size ) ) {
+        munmap( view, (size_t)st.st_size );
+        return 0;
+    }
+
+    dir->wad.info = header->info;
+    dir->wad.lumps = (lumpinfo_t*)(base + header->lumpsOfs);
+    dir->index.numslots = header->numslots;
+    dir->index.slots = (uint32_t*)(base + header->slotsOfs);
+    dir->index.numlumps = header->info.numlumps;
+    dir->index.next = (uint32_t*)(base + header->nextOfs);
+    dir->index.lumps = dir->wad.lumps;
+    dir->maps = (mapblock_t*)(base + header->mapsOfs);
+    dir->numMaps = header->numMaps;
+    dir->palLump = header->palLump;
+    dir->cache = view;
+    dir->cacheSize = (size_t)st.st_size;
+    return 1;
+}
+
+// Write an array followed by padding up to an 8 byte boundary
+static void WriteAligned( FILE* f, const void* data, uint64_t size ) {
+    static const uint8_t zeros[8] = {0};
+    if ( size > 0 ) {
+        fwrite( data, 1, (size_t)size, f );
+    }
+    fwrite( zeros, 1, (size_t)(ALIGN8( size ) - size), f );
+}
+
+// Write the cache file for next time
+static void SaveCache( wad_handle_t* wad, const char* cachefile,
+                       const struct stat* wadst, const waddir_t* dir ) {
+    cacheheader_t header;
+    char tmpname[1024];
+    uint64_t numlumps = dir->wad.info.numlumps;
+    FILE* f = NULL;
+    int fd = -1;
+    uint8_t failed = 0;
+
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.id, CACHE_ID, 4 );
+    header.version = CACHE_VERSION;
+    header.endian = CACHE_ENDIAN;
+    header.numslots = dir->index.numslots;
+    header.filesize = (uint64_t)wadst->st_size;
+    header.mtime = (int64_t)wadst->st_mtime;
+    header.hash = HashDirectory( wad, &dir->wad.info );
+    header.info = dir->wad.info;
+    header.numMaps = dir->numMaps;
+    header.palLump = dir->palLump;
+    header.slotsOfs = ALIGN8( sizeof(cacheheader_t) );
+    header.lumpsOfs = header.slotsOfs + ALIGN8( (uint64_t)header.numslots * sizeof(uint32_t) );
+    header.nextOfs = header.lumpsOfs + ALIGN8( numlumps * sizeof(lumpinfo_t) );
+    header.mapsOfs = header.nextOfs + ALIGN8( numlumps * sizeof(uint32_t) );
+
+    // Write to a temporary file first so nobody sees a half written cache.
+    // Each run gets its own, so runs on the same WAD can't write over each
+    // other's before the rename.
+    snprintf( tmpname, sizeof(tmpname), "%s.XXXXXX", cachefile );
+    fd = mkstemp( tmpname );
+    if ( fd >= 0 ) {
+        fchmod( fd, 0644 );
+        f = fdopen( fd, "wb" );
+        if ( f == NULL ) {
+            close( fd );
+            remove( tmpname );
+        }
+    }
+    if ( f == NULL ) {
+        fprintf( stderr, "Warning: can't write cache file %s.\n", cachefile );
+        return;
+    }
+    WriteAligned( f, &header, sizeof(header) );
+    WriteAligned( f, dir->index.slots, (uint64_t)header.numslots * sizeof(uint32_t) );
+    WriteAligned( f, dir->wad.lumps, numlumps * sizeof(lumpinfo_t) );
+    WriteAligned( f, dir->index.next, numlumps * sizeof(uint32_t) );
+    WriteAligned( f, dir->maps, (uint64_t)dir->numMaps * sizeof(mapblock_t) );
+    failed = (ferror( f ) != 0);
+    failed |= (fclose( f ) != 0);
+    if ( failed || rename( tmpname, cachefile ) != 0 ) {
+        fprintf( stderr, "Warning: can't write cache file %s.\n", cachefile );
+        remove( tmpname );
+    }
+}
+
+/*
+** Load the directory of an open WAD
+*/
+void WAD_LoadDir( wad_handle_t* wad, const char* wadfilename,
+                  const char* cachefile, waddir_t* dir ) {
+    struct stat wadst;
+    uint8_t useCache = (cachefile != NULL && stat( wadfilename, &wadst ) == 0);
+
+    memset( dir, 0, sizeof(waddir_t) );
+    if ( useCache && LoadCache( wad, cachefile, &wadst, dir ) ) {
+        return;
+    }
+
+    // Read all the lump entries in the directory
+    WAD_ReadHeader( wad, &dir->wad.info );
+    WAD_ReadDirectory( wad, &dir->wad );
+    WAD_BuildLumpIndex( &dir->index, &dir->wad );
+    // Find palette
+    dir->palLump = WAD_FindLastLump( &dir->index, "PLAYPAL" );
+    // Find every map in one pass over the directory
+    dir->numMaps = WAD_FindMaps( &dir->wad, &dir->maps );
+
+    if ( useCache ) {
+        SaveCache( wad, cachefile, &wadst, dir );
+    }
+}
+
+/*
+** Free a loaded directory
+*/
+void WAD_FreeDir( waddir_t* dir ) {
+    if ( dir->cache != NULL ) {
+        munmap( dir->cache, dir->cacheSize );
+    } else {
+        free( dir->maps );
+        WAD_FreeLumpIndex( &dir->index );
+        if ( !dir->wad.mapped ) {
+            free( dir->wad.lumps );
+        }
+    }
+    memset( dir, 0, sizeof(waddir_t) );
+}
@@ -0,0 +1,39 @@
+/*
+** wad_dir.h
+**
+** Loading a WAD's lump directory and everything derived from it, with an
+** optional cache file so repeat runs can skip the work
+*/
+
+#ifndef __WAD_DIR_H
+#define __WAD_DIR_H
+
+#include "shared.h"
+#include "wad_reader.h"
+#include "lump_index.h"
+
+// Everything known about a WAD's lump directory
+typedef struct {
+    wadfile_t   wad;       // Header and lump directory
+    lumpindex_t index;     // Lump name index
+    mapblock_t* maps;      // Where the lumps of every map are
+    uint32_t    numMaps;   // Number of maps
+    uint32_t    palLump;   // Lump number of the palette, LUMP_NONE if none
+    void*       cache;     // Mapped cache file the arrays point into, if any
+    size_t      cacheSize; // Size of the mapped cache file
+} waddir_t;
+
+/*
+** Load the directory of an open WAD. If cachefile isn't NULL it's used when
+** it matches the WAD, otherwise the directory is parsed and the cache file
+** is written for next time.
+*/
+void WAD_LoadDir( wad_handle_t* wad, const char* wadfilename,
+                  const char* cachefile, waddir_t* dir );
+
+/*
+** Free a loaded directory
+*/
+void WAD_FreeDir( waddir_t* dir );
+
+#endif
@@ -0,0 +1,237 @@
+/*
+** wad_dump.c
+**
+** Machine readable dumps of the WAD directory, map stats and thing counts
+** as NDJSON or CSV
+*/
+
+#include "wad_dump.h"
+
+// Fields of every record. They're the JSON keys, and the CSV columns in
+// this order, with the fields a record doesn't have left empty.
+typedef enum {
+    COL_RECORD, COL_NAME, COL_ID, COL_INDEX, COL_FILEPOS, COL_SIZE, COL_WIDTH,
+    COL_HEIGHT, COL_THINGS, COL_LINEDEFS, COL_SIDEDEFS, COL_VERTEXES,
+    COL_SECTORS, COL_MAP, COL_CATEGORY, COL_MULTIPLAYER, COL_EASY, COL_NORMAL,
+    COL_HARD, NUM_COLS
+} column_t;
+
+static const char* const columnNames[NUM_COLS] = {
+    "record", "name", "id", "index", "filepos", "size", "width", "height",
+    "things", "linedefs", "sidedefs", "vertexes", "sectors", "map", "category",
+    "multiplayer", "easy", "normal", "hard"
+};
+
+static const char* const formatNames[DUMP_NUMFORMATS] = {"text", "ndjson", "csv"};
+
+dumpformat_t Dump_FormatByName( const char* name ) {
+    uint32_t f = 0;
+
+    for ( f = 0; f < DUMP_NUMFORMATS; ++f ) {
+        if ( strcmp( name, formatNames[f] ) == 0 ) {
+            break;
+        }
+    }
+    return (dumpformat_t)f;
+}
+
+void Dump_GetMapStats( mapstats_t* stats, const map_t* map ) {
+    memcpy( stats->name, map->name, sizeof(stats->name) );
+    stats->width = map->width;
+    stats->height = map->height;
+    stats->numthings = map->numthings;
+    stats->numlinedefs = map->numlinedefs;
+    stats->numsidedefs = map->numsidedefs;
+    stats->numvertexes = map->numvertexes;
+    stats->numsectors = map->numsectors;
+    stats->counted = 0;
+}
+
+// Start the next field, columns must come in order
+static void Field( dumper_t* d, column_t col ) {
+    if ( d->format == DUMP_NDJSON ) {
+        BW_PutChar( d->bw, (col == COL_RECORD) ? '{' : ',' );
+        BW_PutChar( d->bw, '"' );
+        BW_PutStr( d->bw, columnNames[col] );
+        BW_Write( d->bw, "\":", 2 );
+    } else {
+        for ( ; d->column < col; ++d->column ) {
+            BW_PutChar( d->bw, ',' );
+        }
+    }
+}
+
+static void EndRecord( dumper_t* d ) {
+    if ( d->format == DUMP_NDJSON ) {
+        BW_Write( d->bw, "}\n", 2 );
+    } else {
+        Field( d, NUM_COLS - 1 );
+        BW_PutChar( d->bw, '\n' );
+    }
+    d->column = 0;
+}
+
+// Write a string of up to len characters, stopping at a NUL. Lump names
+// can hold any bytes, so they're escaped or quoted as needed.
+static void PutString( dumper_t* d, const char* str, size_t len ) {
+    static const char hex[] = "0123456789abcdef";
+    size_t i = 0;
+
+    if ( d->format == DUMP_CSV ) {
+        uint8_t quote = 0;
+        for ( i = 0; i < len && str[i] != '\0'; ++i ) {
+            if ( str[i] == ',' || str[i] == '"' || str[i] == '\n' || str[i] == '\r' ) {
+                quote = 1;
+            }
+        }
+        len = i;
+        if ( !quote ) {
+            BW_Write( d->bw, str, len );
+            return;
+        }
+    }
+    BW_PutChar( d->bw, '"' );
+    for ( i = 0; i < len && str[i] != '\0'; ++i ) {
+        uint8_t c = (uint8_t)str[i];
+        if ( c == '"' ) {
+            // Doubled in CSV, escaped in JSON
+            BW_PutChar( d->bw, (d->format == DUMP_CSV) ? '"' : '\\' );
+            BW_PutChar( d->bw, '"' );
+        } else if ( d->format == DUMP_NDJSON && c == '\\' ) {
+            BW_Write( d->bw, "\\\\", 2 );
+        } else if ( d->format == DUMP_NDJSON && (c < 0x20 || c >= 0x7f) ) {
+            // Control characters, and bytes that wouldn't be valid UTF-8
+            char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+            BW_Write( d->bw, esc, sizeof(esc) );
+        } else {
+            BW_PutChar( d->bw, (char)c );
+        }
+    }
+    BW_PutChar( d->bw, '"' );
+}
+
+static void StringField( dumper_t* d, column_t col, const char* str, size_t len ) {
+    Field( d, col );
+    PutString( d, str, len );
+}
+
+static void IntField( dumper_t* d, column_t col, int64_t value ) {
+    Field( d, col );
+    BW_PutInt( d->bw, value );
+}
+
+/*
+** Start a NDJSON or CSV dump to a sink
+*/
+uint8_t Dump_Begin( dumper_t* d, dumpformat_t format, const outsink_t* sink ) {
+    uint32_t c = 0;
+
+    d->format = format;
+    d->column = 0;
+    d->bw = BW_OpenSink( sink );
+    if ( d->bw == NULL ) {
+        return 0;
+    }
+    if ( format == DUMP_CSV ) {
+        for ( c = 0; c < NUM_COLS; ++c ) {
+            if ( c > 0 ) {
+                BW_PutChar( d->bw, ',' );
+            }
+            BW_PutStr( d->bw, columnNames[c] );
+        }
+        BW_PutChar( d->bw, '\n' );
+    }
+    return 1;
+}
+
+/*
+** Dump the WAD header
+*/
+void Dump_WadInfo( dumper_t* d, const char* filename, const wadinfo_t* info ) {
+    StringField( d, COL_RECORD, "wad", 3 );
+    StringField( d, COL_NAME, filename, strlen( filename ) );
+    StringField( d, COL_ID, info->id, sizeof(info->id) );
+    // The directory's offset and number of entries
+    IntField( d, COL_FILEPOS, info->infotableofs );
+    IntField( d, COL_SIZE, info->numlumps );
+    EndRecord( d );
+}
+
+/*
+** Dump every lump in the directory
+*/
+void Dump_Lumps( dumper_t* d, const lumpinfo_t* lumps, uint32_t numlumps ) {
+    uint32_t l = 0;
+
+    for ( l = 0; l < numlumps; ++l ) {
+        StringField( d, COL_RECORD, "lump", 4 );
+        StringField( d, COL_NAME, lumps[l].name, sizeof(lumps[l].name) );
+        IntField( d, COL_INDEX, l + 1 );
+        IntField( d, COL_FILEPOS, lumps[l].filepos );
+        IntField( d, COL_SIZE, lumps[l].size );
+        EndRecord( d );
+    }
+}
+
+// Dump the counts of one set of categories
+static void DumpCounts( dumper_t* d, const char* mapname,
+                        const thingCount_t counts[NUMTHINGCATS][MAX_CAT_THINGS],
+                        uint8_t multi ) {
+    uint32_t c = 0, i = 0;
+
+    for ( c = 0; c < NUMTHINGCATS; ++c ) {
+        for ( i = 0; GetThingName( (thingCat_t)c, i ) != NULL; ++i ) {
+            const thingCount_t* count = &counts[c][i];
+            const char* name = GetThingName( (thingCat_t)c, i );
+            const char* cat = GetThingCatName( (thingCat_t)c );
+            if ( count->easy == 0 && count->normal == 0 && count->hard == 0 ) {
+                continue;
+            }
+            StringField( d, COL_RECORD, "things", 6 );
+            StringField( d, COL_NAME, name, strlen( name ) );
+            StringField( d, COL_MAP, mapname, 8 );
+            StringField( d, COL_CATEGORY, cat, strlen( cat ) );
+            Field( d, COL_MULTIPLAYER );
+            if ( d->format == DUMP_NDJSON ) {
+                BW_PutStr( d->bw, multi ? "true" : "false" );
+            } else {
+                BW_PutChar( d->bw, multi ? '1' : '0' );
+            }
+            IntField( d, COL_EASY, count->easy );
+            IntField( d, COL_NORMAL, count->normal );
+            IntField( d, COL_HARD, count->hard );
+            EndRecord( d );
+        }
+    }
+}
+
+/*
+** Dump a map's stats and thing counts
+*/
+void Dump_Map( dumper_t* d, const mapstats_t* stats ) {
+    StringField( d, COL_RECORD, "map", 3 );
+    StringField( d, COL_NAME, stats->name, sizeof(stats->name) );
+    IntField( d, COL_WIDTH, stats->width );
+    IntField( d, COL_HEIGHT, stats->height );
+    IntField( d, COL_THINGS, stats->numthings );
+    IntField( d, COL_LINEDEFS, stats->numlinedefs );
+    IntField( d, COL_SIDEDEFS, stats->numsidedefs );
+    IntField( d, COL_VERTEXES, stats->numvertexes );
+    IntField( d, COL_SECTORS, stats->numsectors );
+    EndRecord( d );
+
+    if ( stats->counted ) {
+        DumpCounts( d, stats->name, stats->counts.single, 0 );
+        DumpCounts( d, stats->name, stats->counts.multi, 1 );
+    }
+}
+
+/*
+** Finish the dump
+*/
+uint8_t Dump_End( dumper_t* d ) {
+    uint8_t ok = BW_Close( d->bw );
+
+    d->bw = NULL;
+    return ok;
+}
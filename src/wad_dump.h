@@ -0,0 +1,77 @@
+/*
+** wad_dump.h
+**
+** Machine readable dumps of the WAD directory, map stats and thing counts
+** as NDJSON or CSV
+*/
+
+#ifndef __WAD_DUMP_H
+#define __WAD_DUMP_H
+
+#include "shared.h"
+#include "buf_writer.h"
+#include "thing_counter.h"
+
+// Dump formats
+typedef enum {
+    DUMP_TEXT,   // The human readable printout
+    DUMP_NDJSON, // One JSON object per line
+    DUMP_CSV,    // One row per record, every record type shares the columns
+    DUMP_NUMFORMATS
+} dumpformat_t;
+
+// What's dumped about a map, kept until it can be written in order
+typedef struct {
+    char          name[8];
+    uint16_t      width, height;
+    uint32_t      numthings, numlinedefs, numsidedefs, numvertexes, numsectors;
+    uint8_t       counted; // Were the things counted?
+    thingcounts_t counts;
+} mapstats_t;
+
+// A dump being written
+typedef struct {
+    dumpformat_t format;
+    bufwriter_t* bw;
+    uint32_t     column; // Next column of the current record
+} dumper_t;
+
+/*
+** Get a format from its name, e.g. "ndjson". Returns DUMP_NUMFORMATS if
+** there's no such format.
+*/
+dumpformat_t Dump_FormatByName( const char* name );
+
+/*
+** Fill in a map's stats, without the thing counts
+*/
+void Dump_GetMapStats( mapstats_t* stats, const map_t* map );
+
+/*
+** Start a NDJSON or CSV dump to a sink. CSV starts with the header row.
+** Returns 0 on failure.
+*/
+uint8_t Dump_Begin( dumper_t* d, dumpformat_t format, const outsink_t* sink );
+
+/*
+** Dump the WAD header
+*/
+void Dump_WadInfo( dumper_t* d, const char* filename, const wadinfo_t* info );
+
+/*
+** Dump every lump in the directory
+*/
+void Dump_Lumps( dumper_t* d, const lumpinfo_t* lumps, uint32_t numlumps );
+
+/*
+** Dump a map's stats and, if they were counted, a record for every kind of
+** thing it has
+*/
+void Dump_Map( dumper_t* d, const mapstats_t* stats );
+
+/*
+** Finish the dump. Returns 0 if anything failed to be written.
+*/
+uint8_t Dump_End( dumper_t* d );
+
+#endif
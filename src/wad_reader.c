@@ -5,148 +5,323 @@
 */
 
 #include "wad_reader.h"
+#include "phase_stats.h"
+#include "trace.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-static FILE* wadfile = NULL;
-static uint32_t i = 0, tmpPos = 0;
+// WAD data is little-endian, only big-endian hosts need to swap anything
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define WAD_BIG_ENDIAN
+#endif
+
+// Lump entries read at a time from the directory, 1 MB worth
+#define DIR_CHUNK_LUMPS 65536
+
+// An open WAD file
+struct wad_handle_s {
+    int            fd;   // File descriptor, -1 once the file is mapped
+    const uint8_t* map;  // Memory mapped view of the whole file, if any
+    size_t         size; // Size of the file
+};
 
 /*
 ** Open a WAD file
 */
-void WAD_OpenFile( const char* filename ) {
-    wadfile = fopen( filename, "rb" );
-    if ( wadfile == NULL ) {
+wad_handle_t* WAD_OpenFile( const char* filename, uint8_t useMmap ) {
+    struct stat st;
+    wad_handle_t* wad = NULL;
+    tracespan_t span;
+    int fd = -1;
+
+    Trace_Begin( &span, "WAD_OpenFile" );
+    fd = open( filename, O_RDONLY );
+    if ( fd < 0 || fstat( fd, &st ) != 0 ) {
         fprintf( stderr, "Error opening WAD file: %s.\n", filename );
-        exit( EXIT_FAILURE );
+        if ( fd >= 0 ) {
+            close( fd );
+        }
+        Trace_End( &span );
+        return NULL;
     }
+    wad = (wad_handle_t*)malloc( sizeof(wad_handle_t) );
+    wad->fd = fd;
+    wad->map = NULL;
+    wad->size = (size_t)st.st_size;
+
+    // Try to map the whole file into memory
+    if ( useMmap && wad->size > 0 ) {
+        void* view = mmap( NULL, wad->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( view != MAP_FAILED ) {
+            wad->map = (const uint8_t*)view;
+            // The mapping stays valid after the descriptor is closed
+            close( fd );
+            wad->fd = -1;
+        }
+        // Otherwise fall back to regular file reads
+    }
+    Trace_End( &span );
+    return wad;
 }
 
 /*
 ** Close a WAD file
 */
-void WAD_CloseFile( void ) {
-    if ( wadfile == NULL ) {
+void WAD_CloseFile( wad_handle_t* wad ) {
+    if ( wad == NULL ) {
         fprintf( stderr, "Error closing WAD file! No open file to close!\n" );
         exit( EXIT_FAILURE );
     }
-    fclose( wadfile );
+    if ( wad->map != NULL ) {
+        munmap( (void*)wad->map, wad->size );
+    }
+    if ( wad->fd >= 0 ) {
+        close( wad->fd );
+    }
+    free( wad );
 }
 
+// Read bytes at a position from the mapped view or the file. Anything past
+// the end of the file reads as zeros.
+static void ReadAt( wad_handle_t* wad, void* dst, uint64_t pos, uint32_t size ) {
+    uint8_t* out = (uint8_t*)dst;
+    uint32_t avail = 0;
+
+    if ( pos < wad->size ) {
+        avail = (wad->size - pos < size) ? (uint32_t)(wad->size - pos) : size;
+    }
+    if ( wad->map != NULL ) {
+        memcpy( out, wad->map + pos, avail );
+    } else {
+        uint32_t done = 0;
+        while ( done < avail ) {
+            ssize_t got = pread( wad->fd, out + done, avail - done,
+                                 (off_t)(pos + done) );
+            if ( got <= 0 ) {
+                break;
+            }
+            done += (uint32_t)got;
+        }
+        avail = done;
+    }
+    Stats_AddRead( avail );
+    memset( out + avail, 0, size - avail );
+}
+
+// Get a pointer straight into the mapped file for a block of data, or NULL
+// if it has to be copied out instead: the file isn't mapped, the host needs
+// the data byte swapped, the block runs past the end of the file or it
+// isn't aligned for the type it holds.
+static const void* MappedSpan( wad_handle_t* wad, uint64_t pos, uint64_t size, size_t align ) {
+#ifdef WAD_BIG_ENDIAN
+    return NULL;
+#else
+    if ( wad->map == NULL || pos > wad->size || size > wad->size - pos ||
+         ((uintptr_t)(wad->map + pos) & (align - 1)) != 0 ) {
+        return NULL;
+    }
+    return wad->map + pos;
+#endif
+}
+
+#ifdef WAD_BIG_ENDIAN
+// Swap a run of 16 bit values in place. Kept as a plain loop over the
+// whole block so the compiler can vectorize it.
+static void SwapShorts( void* data, uint32_t count ) {
+    uint16_t* s = (uint16_t*)data;
+    uint32_t n = 0;
+    for ( n = 0; n < count; ++n ) {
+        s[n] = (uint16_t)((s[n] << 8) | (s[n] >> 8));
+    }
+}
+// Swap a run of 32 bit values in place
+static void SwapLongs( void* data, uint32_t count ) {
+    uint32_t* l = (uint32_t*)data;
+    uint32_t n = 0;
+    for ( n = 0; n < count; ++n ) {
+        l[n] = ((l[n] << 24) | ((l[n] << 8) & 0x00FF0000) |
+                ((l[n] >> 8) & 0x0000FF00) | (l[n] >> 24));
+    }
+}
+#endif
+
 /*
-** Read WAD header
+** Read raw bytes from anywhere in the file
 */
-void WAD_ReadHeader( wadinfo_t* info ) {
-    fread( info->id, 1, 4, wadfile );            // ID
-    fread( &info->numlumps, 1, 4, wadfile );     // numlumps
-    fread( &info->infotableofs, 1, 4, wadfile ); // infotableofs
-    // Seek to beginning of lump directory
-    fseek( wadfile, info->infotableofs, SEEK_SET );
+void WAD_ReadRaw( wad_handle_t* wad, void* dst, uint64_t pos, uint32_t size ) {
+    ReadAt( wad, dst, pos, size );
+}
+
+// Read a block of lump data in one go
+static void ReadLumpBlock( wad_handle_t* wad, void* dst, const lumpinfo_t* lump,
+                           uint32_t size ) {
+    ReadAt( wad, dst, lump->filepos, size );
 }
 
 /*
-** Read a lump info
+** Read WAD header
 */
-void WAD_ReadLump( lumpinfo_t* lump ) {
-    fread( &lump->filepos, 1, 4, wadfile ); // filepos
-    fread( &lump->size, 1, 4, wadfile );    // size
-    fread( lump->name, 1, 8, wadfile );     // name
+void WAD_ReadHeader( wad_handle_t* wad, wadinfo_t* info ) {
+    ReadAt( wad, info, 0, sizeof(wadinfo_t) ); // ID, numlumps, infotableofs
+#ifdef WAD_BIG_ENDIAN
+    SwapLongs( &info->numlumps, 2 );
+#endif
 }
 
-// Save position and seek
-static void SaveAndSeek( uint32_t* pos ) {
-    tmpPos = ftell( wadfile );
-    fseek( wadfile, *pos, SEEK_SET );
-}
-// Restore saved position
-static void RestorePosition( void ) {
-    fseek( wadfile, tmpPos, SEEK_SET );
+/*
+** Read the lump directory
+*/
+void WAD_ReadDirectory( wad_handle_t* wad, wadfile_t* wadfile ) {
+    uint32_t numlumps = wadfile->info.numlumps;
+    uint32_t l = 0, count = 0;
+    uint64_t bytes = (uint64_t)numlumps * sizeof(lumpinfo_t);
+
+    // Use the directory where it is in a mapped file
+    wadfile->lumps = (lumpinfo_t*)MappedSpan( wad, wadfile->info.infotableofs, bytes,
+                                              __alignof__(lumpinfo_t) );
+    wadfile->mapped = (wadfile->lumps != NULL);
+    if ( wadfile->mapped ) {
+        Stats_AddRead( bytes );
+        return;
+    }
+    if ( bytes < SIZE_MAX ) {
+        wadfile->lumps = (lumpinfo_t*)malloc( (size_t)bytes + 1 );
+    }
+    if ( wadfile->lumps == NULL ) {
+        fprintf( stderr, "Error allocating lump directory!\n" );
+        exit( EXIT_FAILURE );
+    }
+    Stats_AddAlloc();
+    // filepos, size, name for every lump, a chunk at a time so each read
+    // stays within ReadAt's 32 bit size however big the directory is
+    for ( l = 0; l < numlumps; l += count ) {
+        count = (numlumps - l < DIR_CHUNK_LUMPS) ? numlumps - l : DIR_CHUNK_LUMPS;
+        ReadAt( wad, &wadfile->lumps[l],
+                wadfile->info.infotableofs + (uint64_t)l * sizeof(lumpinfo_t),
+                count * sizeof(lumpinfo_t) );
+#ifdef WAD_BIG_ENDIAN
+        {
+            uint32_t c = 0;
+            for ( c = l; c < l + count; ++c ) {
+                SwapLongs( &wadfile->lumps[c], 2 );
+            }
+        }
+#endif
+    }
 }
 
 /*
 ** Read the first palette
 */
-void WAD_ReadPalette( color_t* pal, lumpinfo_t* lump ) {
-    SaveAndSeek( &lump->filepos );
-    for ( i = 0; i < 256; ++i ) {
-        fread( &pal[i].r, 1, 1, wadfile );
-        fread( &pal[i].g, 1, 1, wadfile );
-        fread( &pal[i].b, 1, 1, wadfile );
+const color_t* WAD_ReadPalette( wad_handle_t* wad, color_t* pal, const lumpinfo_t* lump ) {
+    const color_t* span = NULL;
+
+    if ( lump->size >= 256 * sizeof(color_t) ) {
+        span = (const color_t*)MappedSpan( wad, lump->filepos, 256 * sizeof(color_t),
+                                           __alignof__(color_t) );
+    }
+    if ( span != NULL ) {
+        Stats_AddRead( 256 * sizeof(color_t) );
+        return span;
     }
-    RestorePosition();
+    ReadLumpBlock( wad, pal, lump, 256 * sizeof(color_t) );
+    return pal;
+}
+
+// Get a map's THINGS where they are in a mapped file, or NULL if they have
+// to be read into the arena
+static const thing_t* MappedThings( wad_handle_t* wad, const lumpinfo_t* lump ) {
+    return (const thing_t*)MappedSpan( wad, lump->filepos,
+                                       lump->size / sizeof(thing_t) * sizeof(thing_t),
+                                       __alignof__(thing_t) );
 }
 
 /*
 ** Read map THINGS
 */
-void WAD_ReadMapThings( map_t* map, lumpinfo_t* lump ) {
+void WAD_ReadMapThings( wad_handle_t* wad, map_t* map, const lumpinfo_t* lump,
+                       maparena_t* arena ) {
+    tracespan_t span;
+
+    Trace_Begin( &span, "WAD_ReadMapThings" );
     map->numthings = lump->size / sizeof(thing_t);
-    map->things = (thing_t*)malloc( lump->size );
-    // Save current position and seek to lump data
-    SaveAndSeek( &lump->filepos );
-    for ( i = 0; i < map->numthings; ++i ) {
-        fread( &map->things[i].x, 1, 2, wadfile );
-        fread( &map->things[i].y, 1, 2, wadfile );
-        fread( &map->things[i].angle, 1, 2, wadfile );
-        fread( &map->things[i].type, 1, 2, wadfile );
-        fread( &map->things[i].flags, 1, 2, wadfile );
+    // The in-memory layout matches the lump, so use it where it is or read
+    // it all at once
+    map->things = (thing_t*)MappedThings( wad, lump );
+    if ( map->things != NULL ) {
+        Stats_AddRead( map->numthings * sizeof(thing_t) );
+        Trace_End( &span );
+        return;
     }
-    // Done reading so jump back to where we were
-    RestorePosition();
+    map->things = (thing_t*)MapArena_Alloc( arena, map->numthings * sizeof(thing_t) );
+    ReadLumpBlock( wad, map->things, lump, map->numthings * sizeof(thing_t) );
+#ifdef WAD_BIG_ENDIAN
+    SwapShorts( map->things, map->numthings * sizeof(thing_t) / 2 );
+#endif
+    Trace_End( &span );
 }
 
 /*
 ** Read map LINEDEFS
 */
-void WAD_ReadMapLinedefs( map_t* map, lumpinfo_t* lump ) {
+void WAD_ReadMapLinedefs( wad_handle_t* wad, map_t* map, const lumpinfo_t* lump,
+                       maparena_t* arena ) {
+    tracespan_t span;
+
+    Trace_Begin( &span, "WAD_ReadMapLinedefs" );
     map->numlinedefs = lump->size / sizeof(linedef_t);
-    map->linedefs = (linedef_t*)malloc( lump->size );
-    // Save current position and seek to lump data
-    SaveAndSeek( &lump->filepos );
-    for ( i = 0; i < map->numlinedefs; ++i ) {
-        fread( &map->linedefs[i].v1, 1, 2, wadfile );
-        fread( &map->linedefs[i].v2, 1, 2, wadfile );
-        fread( &map->linedefs[i].flags, 1, 2, wadfile );
-        fread( &map->linedefs[i].special, 1, 2, wadfile );
-        fread( &map->linedefs[i].tag, 1, 2, wadfile );
-        fread( &map->linedefs[i].sidenum[0], 1, 2, wadfile );
-        fread( &map->linedefs[i].sidenum[1], 1, 2, wadfile );
-    }
-    // Done reading so jump back to where we were
-    RestorePosition();
+    map->linedefs = (linedef_t*)MapArena_Alloc( arena, map->numlinedefs * sizeof(linedef_t) );
+    ReadLumpBlock( wad, map->linedefs, lump, map->numlinedefs * sizeof(linedef_t) );
+#ifdef WAD_BIG_ENDIAN
+    SwapShorts( map->linedefs, map->numlinedefs * sizeof(linedef_t) / 2 );
+#endif
+    Trace_End( &span );
 }
 
 /*
 ** Read map SIDEDEFS
 */
-void WAD_ReadMapSidedefs( map_t* map, lumpinfo_t* lump ) {
+void WAD_ReadMapSidedefs( wad_handle_t* wad, map_t* map, const lumpinfo_t* lump,
+                       maparena_t* arena ) {
+    tracespan_t span;
+
+    Trace_Begin( &span, "WAD_ReadMapSidedefs" );
     map->numsidedefs = lump->size / sizeof(sidedef_t);
-    map->sidedefs = (sidedef_t*)malloc( lump->size );
-    // Save current position and seek to lump data
-    SaveAndSeek( &lump->filepos );
-    for ( i = 0; i < map->numsidedefs; ++i ) {
-        fread( &map->sidedefs[i].xofs, 1, 2, wadfile );
-        fread( &map->sidedefs[i].yofs, 1, 2, wadfile );
-        fread( map->sidedefs[i].uppertexture, 1, 8, wadfile );
-        fread( map->sidedefs[i].lowertexture, 1, 8, wadfile );
-        fread( map->sidedefs[i].middletexture, 1, 8, wadfile );
-        fread( &map->sidedefs[i].sectornum, 1, 2, wadfile );
+    map->sidedefs = (sidedef_t*)MapArena_Alloc( arena, map->numsidedefs * sizeof(sidedef_t) );
+    ReadLumpBlock( wad, map->sidedefs, lump, map->numsidedefs * sizeof(sidedef_t) );
+#ifdef WAD_BIG_ENDIAN
+    {
+        // Texture names are left alone
+        uint32_t i = 0;
+        for ( i = 0; i < map->numsidedefs; ++i ) {
+            SwapShorts( &map->sidedefs[i].xofs, 2 );
+            SwapShorts( &map->sidedefs[i].sectornum, 1 );
+        }
     }
-    // Done reading so jump back to where we were
-    RestorePosition();
+#endif
+    Trace_End( &span );
 }
 
 /*
 ** Read map VERTEXES
 */
-void WAD_ReadMapVertexes( map_t* map, lumpinfo_t* lump ) {
+void WAD_ReadMapVertexes( wad_handle_t* wad, map_t* map, const lumpinfo_t* lump,
+                       maparena_t* arena ) {
     vertex_t minv = {INT16_MAX, INT16_MAX};
     vertex_t maxv = {INT16_MIN, INT16_MIN};
+    uint32_t i = 0;
+    tracespan_t span;
+
+    Trace_Begin( &span, "WAD_ReadMapVertexes" );
     map->numvertexes = lump->size / sizeof(vertex_t);
-    map->vertexes = (vertex_t*)malloc( lump->size );
-    // Save current position and seek to lump data
-    SaveAndSeek( &lump->filepos );
+    map->vertexes = (vertex_t*)MapArena_Alloc( arena, map->numvertexes * sizeof(vertex_t) );
+    ReadLumpBlock( wad, map->vertexes, lump, map->numvertexes * sizeof(vertex_t) );
+#ifdef WAD_BIG_ENDIAN
+    SwapShorts( map->vertexes, map->numvertexes * 2 );
+#endif
     for ( i = 0; i < map->numvertexes; ++i ) {
-        fread( &map->vertexes[i].x, 1, 2, wadfile );
-        fread( &map->vertexes[i].y, 1, 2, wadfile );
         // Determine minimum and maximum points
         minv.x = (map->vertexes[i].x < minv.x)
                ? map->vertexes[i].x : minv.x;
@@ -157,33 +332,103 @@ void WAD_ReadMapVertexes( map_t* map, lumpinfo_t* lump ) {
         maxv.y = (map->vertexes[i].y > maxv.y)
                ? map->vertexes[i].y : maxv.y;
     }
+    if ( map->numvertexes == 0 ) {
+        minv.x = minv.y = maxv.x = maxv.y = 0;
+    }
     // Determine map dimensions
     map->width = maxv.x - minv.x;
     map->height = maxv.y - minv.y;
     // Determine center point
     map->centerv.x = minv.x + map->width / 2;
     map->centerv.y = minv.y + map->height / 2;
-    // Done reading so jump back to where we were
-    RestorePosition();
+    Trace_End( &span );
 }
 
 /*
 ** Read map SECTORS
 */
-void WAD_ReadMapSectors( map_t* map, lumpinfo_t* lump ) {
+void WAD_ReadMapSectors( wad_handle_t* wad, map_t* map, const lumpinfo_t* lump,
+                       maparena_t* arena ) {
+    tracespan_t span;
+
+    Trace_Begin( &span, "WAD_ReadMapSectors" );
     map->numsectors = lump->size / sizeof(sector_t);
-    map->sectors = (sector_t*)malloc( lump->size );
-    // Save current position and seek to lump data
-    SaveAndSeek( &lump->filepos );
-    for ( i = 0; i < map->numsectors; ++i ) {
-        fread( &map->sectors[i].floorheight, 1, 2, wadfile );
-        fread( &map->sectors[i].ceilingheight, 1, 2, wadfile );
-        fread( map->sectors[i].floorflat, 1, 8, wadfile );
-        fread( map->sectors[i].ceilingflat, 1, 8, wadfile );
-        fread( &map->sectors[i].lightlevel, 1, 2, wadfile );
-        fread( &map->sectors[i].type, 1, 2, wadfile );
-        fread( &map->sectors[i].tag, 1, 2, wadfile );
-    }
-    // Done reading so jump back to where we were
-    RestorePosition();
+    map->sectors = (sector_t*)MapArena_Alloc( arena, map->numsectors * sizeof(sector_t) );
+    ReadLumpBlock( wad, map->sectors, lump, map->numsectors * sizeof(sector_t) );
+#ifdef WAD_BIG_ENDIAN
+    {
+        // Flat names are left alone
+        uint32_t i = 0;
+        for ( i = 0; i < map->numsectors; ++i ) {
+            SwapShorts( &map->sectors[i].floorheight, 2 );
+            SwapShorts( &map->sectors[i].lightlevel, 3 );
+        }
+    }
+#endif
+    Trace_End( &span );
+}
+
+// Size of a lump's array in the arena
+#define LUMP_ARENA_SIZE(n, type) \
+    ((n) == LUMP_NONE ? 0 : MapArena_Size( lumps[n].size / sizeof(type) * sizeof(type) ))
+
+/*
+** Read the parts of a map that are needed
+*/
+void WAD_ReadMap( wad_handle_t* wad, const wadfile_t* wadfile,
+                  const mapblock_t* block, uint32_t parts, maparena_t* arena,
+                  map_t* map ) {
+    const lumpinfo_t* lumps = wadfile->lumps;
+    const uint32_t* ml = block->lumps;
+    size_t size = 0;
+    phasetimer_t timer;
+    tracespan_t span;
+
+    Trace_Begin( &span, "WAD_ReadMap" );
+    // Anything not read stays empty
+    memset( map, 0, sizeof(map_t) );
+    memcpy( map->name, block->name, 8 );
+
+    // Make room for everything up front so the arrays sit together
+    if ( (parts & MAP_READ_THINGS) && ml[ML_THINGS] != LUMP_NONE &&
+         MappedThings( wad, &lumps[ml[ML_THINGS]] ) == NULL ) {
+        size += LUMP_ARENA_SIZE( ml[ML_THINGS], thing_t );
+    }
+    if ( parts & MAP_READ_LINES ) {
+        size += LUMP_ARENA_SIZE( ml[ML_LINEDEFS], linedef_t );
+        size += LUMP_ARENA_SIZE( ml[ML_SIDEDEFS], sidedef_t );
+        size += LUMP_ARENA_SIZE( ml[ML_VERTEXES], vertex_t );
+        size += LUMP_ARENA_SIZE( ml[ML_SECTORS], sector_t );
+    }
+    MapArena_Reset( arena, size );
+
+    // Geometry first, in the order the drawer walks it
+    if ( parts & MAP_READ_LINES ) {
+        if ( ml[ML_LINEDEFS] != LUMP_NONE ) {
+            Stats_Begin( &timer, PHASE_LINEDEFS );
+            WAD_ReadMapLinedefs( wad, map, &lumps[ml[ML_LINEDEFS]], arena );
+            Stats_End( &timer );
+        }
+        if ( ml[ML_VERTEXES] != LUMP_NONE ) {
+            Stats_Begin( &timer, PHASE_VERTEXES );
+            WAD_ReadMapVertexes( wad, map, &lumps[ml[ML_VERTEXES]], arena );
+            Stats_End( &timer );
+        }
+        if ( ml[ML_SIDEDEFS] != LUMP_NONE ) {
+            Stats_Begin( &timer, PHASE_SIDEDEFS );
+            WAD_ReadMapSidedefs( wad, map, &lumps[ml[ML_SIDEDEFS]], arena );
+            Stats_End( &timer );
+        }
+        if ( ml[ML_SECTORS] != LUMP_NONE ) {
+            Stats_Begin( &timer, PHASE_SECTORS );
+            WAD_ReadMapSectors( wad, map, &lumps[ml[ML_SECTORS]], arena );
+            Stats_End( &timer );
+        }
+    }
+    if ( (parts & MAP_READ_THINGS) && ml[ML_THINGS] != LUMP_NONE ) {
+        Stats_Begin( &timer, PHASE_THINGS );
+        WAD_ReadMapThings( wad, map, &lumps[ml[ML_THINGS]], arena );
+        Stats_End( &timer );
+    }
+    Trace_End( &span );
 }
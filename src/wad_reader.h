@@ -8,55 +8,99 @@
 #define __WAD_READER_H
 
 #include "shared.h"
+#include "map_arena.h"
+
+// An open WAD file. Every read is positional so a handle can be shared by
+// any number of threads, and any number of handles can be open at once.
+typedef struct wad_handle_s wad_handle_t;
+
+// Parts of a map for WAD_ReadMap to read
+#define MAP_READ_THINGS 0x01 // THINGS
+#define MAP_READ_LINES  0x02 // LINEDEFS, SIDEDEFS, VERTEXES and SECTORS
 
 /*
-** Open a WAD file
+** Open a WAD file. If useMmap is set the whole file is mapped into memory
+** and read from there, falling back to regular reads if mapping fails.
+** Returns NULL if the file can't be opened.
 */
-void WAD_OpenFile( const char* filename );
+wad_handle_t* WAD_OpenFile( const char* filename, uint8_t useMmap );
 
 /*
 ** Close a WAD file
 */
-void WAD_CloseFile( void );
+void WAD_CloseFile( wad_handle_t* wad );
+
+/*
+** Read raw bytes from anywhere in the file, without any byte swapping.
+** Anything past the end of the file reads as zeros.
+*/
+void WAD_ReadRaw( wad_handle_t* wad, void* dst, uint64_t pos, uint32_t size );
 
 /*
 ** Read WAD header
 */
-void WAD_ReadHeader( wadinfo_t* info );
+void WAD_ReadHeader( wad_handle_t* wad, wadinfo_t* info );
 
 /*
-** Read a lump info
+** Read the lump directory described by wadfile->info into wadfile->lumps.
+** If the file is mapped and the directory can be used where it is, lumps
+** points into the mapping and mapped is set, so the file has to stay open
+** until the directory is done with.
 */
-void WAD_ReadLump( lumpinfo_t* lump );
+void WAD_ReadDirectory( wad_handle_t* wad, wadfile_t* wadfile );
 
 /*
-** Read the first palette
+** Read the first palette. Returns a pointer to it straight into the mapped
+** file if it can be used there, which lasts until the file is closed.
+** Otherwise it's read into pal and pal is returned.
+*/
+const color_t* WAD_ReadPalette( wad_handle_t* wad, color_t* pal, const lumpinfo_t* lump );
+
+/*
+** The WAD_ReadMap* functions take their arrays from the arena, which must
+** have been reset with enough room for them. THINGS are used straight from
+** the mapped file instead when they can be, so the map is also only valid
+** until the file is closed.
 */
-void WAD_ReadPalette( color_t* pal, lumpinfo_t* lump );
 
 /*
 ** Read map THINGS
 */
-void WAD_ReadMapThings( map_t* map, lumpinfo_t* lump );
+void WAD_ReadMapThings( wad_handle_t* wad, map_t* map, const lumpinfo_t* lump,
+                       maparena_t* arena );
 
 /*
 ** Read map LINEDEFS
 */
-void WAD_ReadMapLinedefs( map_t* map, lumpinfo_t* lump );
+void WAD_ReadMapLinedefs( wad_handle_t* wad, map_t* map, const lumpinfo_t* lump,
+                       maparena_t* arena );
 
 /*
 ** Read map SIDEDEFS
 */
-void WAD_ReadMapSidedefs( map_t* map, lumpinfo_t* lump );
+void WAD_ReadMapSidedefs( wad_handle_t* wad, map_t* map, const lumpinfo_t* lump,
+                       maparena_t* arena );
 
 /*
 ** Read map VERTEXES
 */
-void WAD_ReadMapVertexes( map_t* map, lumpinfo_t* lump );
+void WAD_ReadMapVertexes( wad_handle_t* wad, map_t* map, const lumpinfo_t* lump,
+                       maparena_t* arena );
 
 /*
 ** Read map SECTORS
 */
-void WAD_ReadMapSectors( map_t* map, lumpinfo_t* lump );
+void WAD_ReadMapSectors( wad_handle_t* wad, map_t* map, const lumpinfo_t* lump,
+                       maparena_t* arena );
+
+/*
+** Read the parts of a map that are needed, see MAP_READ_*. Lumps that
+** aren't needed or that the map doesn't have are left empty. The arena is
+** reset and all of the map's arrays are placed in it, so the map is only
+** valid until the arena is next used.
+*/
+void WAD_ReadMap( wad_handle_t* wad, const wadfile_t* wadfile,
+                  const mapblock_t* block, uint32_t parts, maparena_t* arena,
+                  map_t* map );
 
 #endif
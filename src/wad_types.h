@@ -17,6 +17,9 @@
 #define TFLAG_DEAF      0x0008 // Doesn't react to sound
 #define TFLAG_MULT      0x0010 // Only in multiplayer
 
+// Lump number meaning no lump
+#define LUMP_NONE 0xFFFFFFFF
+
 // WAD info struct
 typedef struct {
     char     id[4];        // Type of WAD; IWAD or PWAD
@@ -81,7 +84,8 @@ typedef struct {
     vertex_t   centerv;       // Center point
 
     uint32_t   numthings;     // Total number of THINGS
-    thing_t*   things;        // Array of all the THINGS
+    thing_t*   things;        // Array of all the THINGS, which may point
+                              // into the mapped WAD so is never written
 
     uint32_t   numlinedefs;   // Total number of LINEDEFS
     linedef_t* linedefs;      // Array of all the LINEDEFS
@@ -96,10 +100,26 @@ typedef struct {
     sector_t*  sectors;       // Array of all the SECTORS
 } map_t;
 
+// Lumps that make up a map, in the order they usually come in
+typedef enum {
+    ML_THINGS, ML_LINEDEFS, ML_SIDEDEFS, ML_VERTEXES, ML_SEGS, ML_SSECTORS,
+    ML_NODES, ML_SECTORS, ML_REJECT, ML_BLOCKMAP, ML_BEHAVIOR, ML_NUMLUMPS
+} maplump_t;
+
+// Where a map's lumps are in the lump directory
+typedef struct {
+    char     name[8];           // Name of map
+    uint32_t marker;            // Lump number of the map marker
+    uint32_t lumps[ML_NUMLUMPS]; // Lump number of each map lump, or
+                                 // LUMP_NONE if the map doesn't have it
+} mapblock_t;
+
 // WAD file struct
 typedef struct {
     wadinfo_t   info;  // WAD file header information
     lumpinfo_t* lumps; // Array of all the lump definitions
+    uint8_t     mapped; // Do the lumps point into the mapped WAD? Then
+                        // they aren't freed
 } wadfile_t;
 
 #endif
@@ -0,0 +1,109 @@
+/*
+** worker_pool.c
+**
+** Runs a batch of independent jobs on a pool of worker threads
+*/
+
+#include "worker_pool.h"
+#include "trace.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// Shared state of a batch of jobs
+typedef struct {
+    jobFunc_t       func;
+    void*           data;
+    uint32_t        numJobs;
+    uint32_t        nextJob; // Next job number to hand out
+    pthread_mutex_t lock;    // Guards nextJob
+    const char*     traceMap; // Map the jobs are for, to tag their spans
+} jobQueue_t;
+
+// A worker thread
+typedef struct {
+    jobQueue_t* queue;
+    uint32_t    num;   // Worker number
+    pthread_t   thread;
+} worker_t;
+
+// Take jobs off the queue until there are none left
+static void* WorkerThread( void* arg ) {
+    worker_t* worker = (worker_t*)arg;
+    jobQueue_t* queue = worker->queue;
+    uint32_t job = 0;
+
+    // Each worker is its own row in a trace, the caller keeps its own
+    if ( worker->num != 0 ) {
+        Trace_SetThread( worker->num );
+        Trace_SetMap( queue->traceMap );
+    }
+    for ( ;; ) {
+        pthread_mutex_lock( &queue->lock );
+        job = queue->nextJob;
+        if ( job < queue->numJobs ) {
+            ++queue->nextJob;
+        }
+        pthread_mutex_unlock( &queue->lock );
+
+        if ( job >= queue->numJobs ) {
+            break;
+        }
+        queue->func( job, worker->num, queue->data );
+    }
+    return NULL;
+}
+
+/*
+** Get the number of worker threads to use
+*/
+uint32_t GetNumWorkers( uint32_t requested ) {
+    long cpus = 0;
+    if ( requested > 0 ) {
+        return requested;
+    }
+    cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    return (cpus > 0) ? (uint32_t)cpus : 1;
+}
+
+/*
+** Run jobs on a pool of worker threads
+*/
+void RunJobs( uint32_t numJobs, uint32_t numWorkers, jobFunc_t func, void* data ) {
+    jobQueue_t queue;
+    worker_t* workers = NULL;
+    uint32_t numThreads = 0, t = 0;
+
+    queue.func = func;
+    queue.data = data;
+    queue.numJobs = numJobs;
+    queue.nextJob = 0;
+    queue.traceMap = Trace_GetMap();
+    pthread_mutex_init( &queue.lock, NULL );
+
+    // No point starting more threads than there are jobs
+    if ( numWorkers > numJobs ) {
+        numWorkers = numJobs;
+    }
+    if ( numWorkers < 1 ) {
+        numWorkers = 1;
+    }
+    // The calling thread is worker 0
+    workers = (worker_t*)malloc( sizeof(worker_t) * numWorkers );
+    workers[0].queue = &queue;
+    workers[0].num = 0;
+    for ( t = 1; t < numWorkers; ++t ) {
+        workers[numThreads + 1].queue = &queue;
+        workers[numThreads + 1].num = numThreads + 1;
+        if ( pthread_create( &workers[numThreads + 1].thread, NULL, WorkerThread,
+                             &workers[numThreads + 1] ) == 0 ) {
+            ++numThreads;
+        }
+    }
+    WorkerThread( &workers[0] );
+
+    for ( t = 1; t <= numThreads; ++t ) {
+        pthread_join( workers[t].thread, NULL );
+    }
+    free( workers );
+    pthread_mutex_destroy( &queue.lock );
+}
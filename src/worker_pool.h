@@ -0,0 +1,27 @@
+/*
+** worker_pool.h
+**
+** Runs a batch of independent jobs on a pool of worker threads
+*/
+
+#ifndef __WORKER_POOL_H
+#define __WORKER_POOL_H
+
+#include "shared.h"
+
+// A job function, called once for every job number. worker is the number
+// of the thread running the job, from 0 to the number of workers - 1.
+typedef void (*jobFunc_t)( uint32_t job, uint32_t worker, void* data );
+
+/*
+** Get the number of worker threads to use. 0 means one per CPU.
+*/
+uint32_t GetNumWorkers( uint32_t requested );
+
+/*
+** Run jobs 0 to numJobs - 1 on up to numWorkers threads and wait for them
+** all to finish. The calling thread works on jobs too.
+*/
+void RunJobs( uint32_t numJobs, uint32_t numWorkers, jobFunc_t func, void* data );
+
+#endif